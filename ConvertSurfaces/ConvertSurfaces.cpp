@@ -22,24 +22,483 @@
  */
 
 #include "../lib/ReadDaVis/ReadDaVis.h"
+#include "../lib/WriterSettings/WriterSettings.h"
+#include "../lib/StageTimer/StageTimer.h"
 #include <vtkIterativeClosestPointTransform.h>
 #include <vtkLandmarkTransform.h>
 #include <vtkTransformPolyDataFilter.h>
 #include <vtkXMLPolyDataWriter.h>
+#include <vtkCriticalSection.h>
+#include <vtkTimerLog.h>
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+
+namespace
+{
+/** The options given on the command line. **/
+struct ConvertOptions
+{
+    bool                        gridTriangulation;
+    bool                        binaryCache;
+    bool                        streaming;
+    bool                        singlePrecision;
+    std::vector<std::string>    componentNames;
+    std::vector<std::string>    dtComponentFiles;
+    std::vector<std::string>    inComponentFiles;
+    int                         batchSurfaces;  // the surfaces converted at once in a batch
+    WriterSettings              writerSettings;
+    std::string                 timingFileName; // the JSON file of the stage times, empty for none
+    StageTimer*                 stageTimer;
+};
+
+/** Read the options in argv from first on. **/
+void ParseOptions(int argc, char **argv, int first, ConvertOptions& options)
+{
+    options.gridTriangulation = false;
+    options.binaryCache = false;
+    options.streaming = false;
+    options.singlePrecision = false;
+    options.batchSurfaces = 2;
+    options.stageTimer = 0;
+    for (int i = first; i < argc; ++i)
+    {
+        std::string option = argv[i];
+        int used = options.writerSettings.ParseOption(argc,argv,i);
+        if (used > 0)
+        {
+            i += used - 1;
+        }
+        else if (option == "--grid")
+        {
+            options.gridTriangulation = true;
+        }
+        else if (option == "--cache")
+        {
+            options.binaryCache = true;
+        }
+        else if (option == "--stream")
+        {
+            options.streaming = true;
+        }
+        else if (option == "--float")
+        {
+            options.singlePrecision = true;
+        }
+        else if (option == "--batch-surfaces" && i + 1 < argc)
+        {
+            options.batchSurfaces = atoi(argv[++i]);
+        }
+        else if (option == "--timing-json" && i + 1 < argc)
+        {
+            options.timingFileName = argv[++i];
+        }
+        else if (option == "--component" && i + 3 < argc)
+        {
+            options.componentNames.push_back(argv[i+1]);
+            options.dtComponentFiles.push_back(argv[i+2]);
+            options.inComponentFiles.push_back(argv[i+3]);
+            i += 3;
+        }
+        else
+        {
+            std::cout<<"Unknown option "<<option<<" ignored."<<std::endl;
+        }
+    }
+}
+
+/** Print the time and memory of each stage of the run, and write them to
+  * jsonFileName as well if it is not empty. **/
+void ReportStages(StageTimer& timer, std::string jsonFileName)
+{
+    std::cout<<std::endl;
+    timer.PrintSummary(std::cout);
+    if (!jsonFileName.empty() && !timer.WriteJSON(jsonFileName))
+    {
+        std::cerr<<"Cannot write the stage times to "<<jsonFileName<<std::endl;
+    }
+}
+
+/** One surface of a batch, built from a height and a strain file. **/
+struct BatchSurface
+{
+    std::string heightFileName;
+    std::string strainFileName;
+    std::string outFileName;
+};
+
+/** The spellings of the part of a file name that marks a height file,
+  * and the matching part of its strain file. **/
+const char* heightNames[] = {"height","Height","HEIGHT"};
+const char* strainNames[] = {"strain","Strain","STRAIN"};
+
+/** The output file for heightFileName, in outPath: the name of the height
+  * file with the height marker replaced by "surface" and the extension
+  * by .vtp. **/
+std::string GetOutFileName(std::string heightFileName, std::string outPath)
+{
+    std::string name = boost::filesystem::path(heightFileName).filename().string();
+    for (int n = 0; n < 3; ++n)
+    {
+        size_t marker = name.rfind(heightNames[n]);
+        if (marker != std::string::npos)
+        {
+            name.replace(marker,strlen(heightNames[n]),"surface");
+            break;
+        }
+    }
+    size_t extension = name.rfind('.');
+    if (extension != std::string::npos && extension > 0)
+    {
+        name.erase(extension);
+    }
+    return outPath + name + ".vtp";
+}
+
+/** Find the surfaces in directory. Each file whose name holds "height"
+  * is paired with the file of the same name with "strain" in its place,
+  * if there is one. The surfaces are sorted by height file name. **/
+void FindSurfaces(std::string directory, std::string outPath, std::vector<BatchSurface>& surfaces)
+{
+    // the caches written by --cache are named after their files, so are left out
+    std::vector<std::string> fileNames;
+    boost::system::error_code error;
+    boost::system::error_code fileError;
+    for (boost::filesystem::directory_iterator file(directory,error), end; !error && file != end; file.increment(error))
+    {
+        if (boost::filesystem::is_regular_file(file->path(),fileError) && file->path().extension() != ".cache")
+        {
+            fileNames.push_back(file->path().string());
+        }
+    }
+    std::sort(fileNames.begin(),fileNames.end());
+
+    for (size_t f = 0; f < fileNames.size(); ++f)
+    {
+        boost::filesystem::path heightPath(fileNames[f]);
+        std::string name = heightPath.filename().string();
+        for (int n = 0; n < 3; ++n)
+        {
+            size_t marker = name.rfind(heightNames[n]);
+            if (marker == std::string::npos)
+            {
+                continue;
+            }
+            std::string strainName = name;
+            strainName.replace(marker,strlen(heightNames[n]),strainNames[n]);
+            boost::filesystem::path strainPath = heightPath.parent_path()/strainName;
+            if (boost::filesystem::is_regular_file(strainPath,fileError))
+            {
+                BatchSurface surface;
+                surface.heightFileName = heightPath.string();
+                surface.strainFileName = strainPath.string();
+                surface.outFileName = GetOutFileName(surface.heightFileName,outPath);
+                surfaces.push_back(surface);
+            }
+            break;
+        }
+    }
+}
+
+/** Read the surfaces of a batch manifest, one per line given as the height
+  * file, the strain file and optionally the output file, separated by
+  * commas. Output files without a directory are put in outPath and those
+  * not given are named as by GetOutFileName. Blank lines and lines
+  * starting with # are skipped. Returns false if the manifest can't be
+  * opened or a line does not give both files. **/
+bool ReadManifest(std::string fileName, std::string outPath, std::vector<BatchSurface>& surfaces)
+{
+    std::ifstream inFile(fileName.c_str());
+    if (!inFile)
+    {
+        std::cerr<<"Cannot open the batch manifest "<<fileName<<std::endl;
+        return false;
+    }
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(inFile,line))
+    {
+        ++lineNumber;
+        std::vector<std::string> fields;
+        std::stringstream lineStream(line);
+        std::string field;
+        while (std::getline(lineStream,field,','))
+        {
+            size_t first = field.find_first_not_of(" \t\r");
+            size_t last = field.find_last_not_of(" \t\r");
+            fields.push_back(first == std::string::npos ? std::string() : field.substr(first,last - first + 1));
+        }
+        if (fields.empty() || (fields.size() == 1 && fields[0].empty()) || !fields[0].compare(0,1,"#"))
+        {
+            continue;
+        }
+        if (fields.size() < 2 || fields.size() > 3 || fields[0].empty() || fields[1].empty())
+        {
+            std::cerr<<"Line "<<lineNumber<<" of "<<fileName<<" does not give a height and a strain file."<<std::endl;
+            return false;
+        }
+
+        BatchSurface surface;
+        surface.heightFileName = fields[0];
+        surface.strainFileName = fields[1];
+        if (fields.size() == 3 && !fields[2].empty())
+        {
+            boost::filesystem::path outFile(fields[2]);
+            surface.outFileName = outFile.has_parent_path() ? outFile.string() : outPath + fields[2];
+        }
+        else
+        {
+            surface.outFileName = GetOutFileName(surface.heightFileName,outPath);
+        }
+        surfaces.push_back(surface);
+    }
+    return true;
+}
+
+/** Whether outFileName is newer than both files of surface. **/
+bool IsUpToDate(const BatchSurface& surface)
+{
+    boost::system::error_code error;
+    std::time_t outTime = boost::filesystem::last_write_time(surface.outFileName,error);
+    if (error)
+    {
+        return false;
+    }
+    std::time_t heightTime = boost::filesystem::last_write_time(surface.heightFileName,error);
+    if (error)
+    {
+        return false;
+    }
+    std::time_t strainTime = boost::filesystem::last_write_time(surface.strainFileName,error);
+    if (error)
+    {
+        return false;
+    }
+    return outTime > heightTime && outTime > strainTime;
+}
+
+/** Converts the surfaces of a batch, one per item. Each item reads its
+  * two files, builds its surface, writes it and lets it go before taking
+  * the next, so only as many grids are held as there are threads. **/
+class BatchJobs : public ParallelRangeFunctor
+{
+public:
+    BatchJobs(const std::vector<BatchSurface>& surfaces, const ConvertOptions& options, int threadsPerSurface)
+        : m_surfaces(surfaces), m_options(options), m_threadsPerSurface(threadsPerSurface)
+    {
+        m_numberOfFinished = 0;
+        m_numberOfSkipped = 0;
+        m_numberOfFailures = 0;
+    }
+
+    void Execute(vtkIdType begin, vtkIdType end, int)
+    {
+        for (vtkIdType k = begin; k < end; ++k)
+        {
+            Convert(m_surfaces[k]);
+        }
+    }
+
+    int GetNumberOfSkipped()
+    {
+        return m_numberOfSkipped;
+    }
+    int GetNumberOfFailures()
+    {
+        return m_numberOfFailures;
+    }
+
+private:
+    void Convert(const BatchSurface& surface)
+    {
+        std::stringstream report;
+        bool skipped = false;
+        bool failed = false;
+        double startTime = vtkTimerLog::GetUniversalTime();
+        if (IsUpToDate(surface))
+        {
+            skipped = true;
+            report<<"up to date, skipped.";
+        }
+        else
+        {
+            try
+            {
+                failed = !ConvertSurface(surface,report);
+            }
+            catch (std::exception& exception)
+            {
+                failed = true;
+                report<<exception.what();
+            }
+        }
+
+        m_lock.Lock();
+        ++m_numberOfFinished;
+        m_numberOfSkipped += skipped ? 1 : 0;
+        m_numberOfFailures += failed ? 1 : 0;
+        std::cout<<"["<<m_numberOfFinished<<"/"<<m_surfaces.size()<<"] "<<surface.heightFileName<<": ";
+        if (failed)
+        {
+            std::cout<<"FAILED. ";
+        }
+        std::cout<<report.str();
+        if (!skipped)
+        {
+            std::cout<<" ("<<vtkTimerLog::GetUniversalTime() - startTime<<" s)";
+        }
+        std::cout<<std::endl;
+        m_lock.Unlock();
+    }
+
+    /** Read, build and write one surface. Returns false and says why in
+      * report if it can't be. **/
+    bool ConvertSurface(const BatchSurface& surface, std::ostream& report)
+    {
+        ReadDaVis reader;
+        reader.SetHeightFileName(surface.heightFileName);
+        reader.SetStrainFileName(surface.strainFileName);
+        reader.SetGridTriangulation(m_options.gridTriangulation);
+        reader.SetBinaryCache(m_options.binaryCache);
+        reader.SetSinglePrecision(m_options.singlePrecision);
+        reader.SetNumberOfThreads(m_threadsPerSurface);
+        reader.SetStageTimer(m_options.stageTimer);
+        if (m_options.streaming)
+        {
+            reader.StreamDataSurface();
+        }
+        else
+        {
+            reader.ReadAll();
+            if (reader.GetHeightReadRate() < 0 || reader.GetStrainReadRate() < 0)
+            {
+                report<<"Cannot read "<<(reader.GetHeightReadRate() < 0 ? surface.heightFileName : surface.strainFileName);
+                return false;
+            }
+            reader.CreateDataSurface();
+        }
+        if (!reader.GetSurface() || reader.GetSurface()->GetNumberOfPoints() == 0)
+        {
+            report<<"No surface could be built from "<<surface.strainFileName;
+            return false;
+        }
+
+        vtkSmartPointer<vtkXMLPolyDataWriter> writer = vtkSmartPointer<vtkXMLPolyDataWriter>::New();
+        writer->SetInput(reader.GetSurface());
+        writer->SetFileName(surface.outFileName.c_str());
+        report<<reader.GetSurface()->GetNumberOfPoints()<<" points to "<<surface.outFileName<<", ";
+        ScopedStage stage(m_options.stageTimer,"write");
+        if (!m_options.writerSettings.Write(writer,report))
+        {
+            report<<"cannot be written.";
+            return false;
+        }
+        return true;
+    }
+
+    const std::vector<BatchSurface>&    m_surfaces;
+    const ConvertOptions&               m_options;
+    int                                 m_threadsPerSurface;
+    vtkSimpleCriticalSection            m_lock;
+    int                                 m_numberOfFinished;
+    int                                 m_numberOfSkipped;
+    int                                 m_numberOfFailures;
+};
+
+/** Convert every surface found in source, a directory or a manifest, into
+  * outPath, options.batchSurfaces at a time. Returns EXIT_FAILURE if any
+  * surface failed. **/
+int RunBatch(std::string source, std::string outPath, const ConvertOptions& options)
+{
+    std::vector<BatchSurface> surfaces;
+    boost::system::error_code error;
+    if (boost::filesystem::is_directory(source,error))
+    {
+        FindSurfaces(source,outPath,surfaces);
+    }
+    else if (!ReadManifest(source,outPath,surfaces))
+    {
+        return EXIT_FAILURE;
+    }
+    if (surfaces.empty())
+    {
+        std::cout<<"No height and strain files found in "<<source<<std::endl;
+        return 0;
+    }
+    if (!options.componentNames.empty())
+    {
+        std::cout<<"Strain components are not read in a batch, --component ignored."<<std::endl;
+    }
+
+    // the surfaces are handed out one at a time and the parsing threads are
+    // shared between those being converted
+    int numberOfProcessors = ParallelRange::GetNumberOfThreads(0);
+    int numberOfSurfaces = (options.batchSurfaces > 0) ? options.batchSurfaces : 1;
+    numberOfSurfaces = (static_cast<size_t>(numberOfSurfaces) > surfaces.size()) ? surfaces.size() : numberOfSurfaces;
+    int threadsPerSurface = numberOfProcessors/numberOfSurfaces;
+    threadsPerSurface = (threadsPerSurface < 1) ? 1 : threadsPerSurface;
+    std::cout<<"Converting "<<surfaces.size()<<" surfaces, "<<numberOfSurfaces<<" at a time"<<std::endl;
+
+    double startTime = vtkTimerLog::GetUniversalTime();
+    BatchJobs jobs(surfaces,options,threadsPerSurface);
+    ParallelRange::Execute(surfaces.size(),&jobs,1,numberOfSurfaces);
+    int numberOfConverted = surfaces.size() - jobs.GetNumberOfSkipped() - jobs.GetNumberOfFailures();
+    std::cout<<numberOfConverted<<" surfaces converted, "<<jobs.GetNumberOfSkipped()<<" up to date and "<<
+               jobs.GetNumberOfFailures()<<" failed in "<<vtkTimerLog::GetUniversalTime() - startTime<<" s"<<std::endl;
+    return (jobs.GetNumberOfFailures() == 0) ? 0 : EXIT_FAILURE;
+}
+}
 
 int main(int argc, char **argv)
 {
+    if (argc >= 4 && std::string(argv[1]) == "--batch")
+    {
+        StageTimer timer;
+        ConvertOptions options;
+        ParseOptions(argc,argv,4,options);
+        options.stageTimer = &timer;
+
+        std::string outPath = argv[3];
+        if (outPath.compare(outPath.length()-1,1,"/"))
+        {
+            outPath.append("/");
+        }
+        int result = RunBatch(argv[2],outPath,options);
+        ReportStages(timer,options.timingFileName);
+        return result;
+    }
+
     if (argc < 6)
     {
         std::cerr<<"Not enough inputs.\nUsage:"<<std::endl;
-        std::cerr<<argv[0]<<" [DropTower Surfrace] [DropTower Strain] [Instron Surface] [Instron Strain] [Output Folder]"<<std::endl<<"Aborted."<<std::endl;
+        std::cerr<<argv[0]<<" [DropTower Surfrace] [DropTower Strain] [Instron Surface] [Instron Strain] [Output Folder] [Options]"<<std::endl;
+        std::cerr<<argv[0]<<" --batch [Directory or Manifest] [Output Folder] [Options]"<<std::endl;
+        std::cerr<<"A batch converts every height file in the directory whose name holds \"height\" and that has a"<<std::endl;
+        std::cerr<<"strain file of the same name with \"strain\" in its place, or every line of a manifest given as"<<std::endl;
+        std::cerr<<"[Height File],[Strain File],[Optional Output File]. Each surface is written to the output folder"<<std::endl;
+        std::cerr<<"named after its height file with \"surface\" in place of \"height\", and is skipped if that is"<<std::endl;
+        std::cerr<<"already newer than both files."<<std::endl;
+        std::cerr<<"Options:"<<std::endl;
+        std::cerr<<"  --grid    Triangulate using the measurement grid instead of Delaunay. Masked holes are kept."<<std::endl;
+        std::cerr<<"  --cache   Keep a binary copy of each parsed file next to it (file.cache) and read that on later runs."<<std::endl;
+        std::cerr<<"  --stream  Build each surface a row at a time while reading, without holding the whole grids. Implies --grid."<<std::endl;
+        std::cerr<<"  --float   Read the grids and store the strains in single precision."<<std::endl;
+        std::cerr<<"  --batch-surfaces [N]"<<std::endl;
+        std::cerr<<"            The surfaces converted, and so held in memory, at once in a batch. The default is 2."<<std::endl;
+        std::cerr<<"  --timing-json [File]"<<std::endl;
+        std::cerr<<"            Write the time and peak memory of each stage, printed at the end of the run, to File as JSON."<<std::endl;
+        std::cerr<<"  --component [Name] [DropTower File] [Instron File]"<<std::endl;
+        std::cerr<<"            Add another strain component, stored as the array Name on the same surfaces. May be repeated."<<std::endl;
+        WriterSettings::PrintOptions(std::cerr);
+        std::cerr<<"Aborted."<<std::endl;
         return EXIT_FAILURE;
     }
-    if (argc > 6)
-    {
-        std::cout<<"Too many inputs give. Extra inputs ignored.\nUsage:"<<std::endl;
-        std::cout<<argv[0]<<" [DropTower Surfrace] [DropTower Strain] [Instron Surface] [Instron Strain] [Output Folder]"<<std::endl;
-    }
+    StageTimer timer;
+    ConvertOptions options;
+    ParseOptions(argc,argv,6,options);
+    options.stageTimer = &timer;
 
     ReadDaVis *dtReader = new ReadDaVis;
     dtReader->SetHeightFileName(argv[1]);
@@ -49,17 +508,47 @@ int main(int argc, char **argv)
     inReader->SetHeightFileName(argv[3]);
     inReader->SetStrainFileName(argv[4]);
 
-    std::cout<<"Reading drop tower file..."<<std::endl;
-    dtReader->ReadHeightFile();
-    dtReader->ReadStrainFile();
-    dtReader->CreateDataSurface();
-    std::cout<<"Drop tower file successfully read. Number of points in droptower surface: "<<dtReader->GetSurface()->GetNumberOfPoints()<<std::endl;
+    dtReader->SetGridTriangulation(options.gridTriangulation);
+    inReader->SetGridTriangulation(options.gridTriangulation);
+    dtReader->SetBinaryCache(options.binaryCache);
+    inReader->SetBinaryCache(options.binaryCache);
+    dtReader->SetSinglePrecision(options.singlePrecision);
+    inReader->SetSinglePrecision(options.singlePrecision);
+    dtReader->SetStageTimer(&timer);
+    inReader->SetStageTimer(&timer);
+    for (unsigned int i = 0; i < options.componentNames.size(); ++i)
+    {
+        dtReader->AddStrainComponent(options.dtComponentFiles[i],options.componentNames[i]);
+        inReader->AddStrainComponent(options.inComponentFiles[i],options.componentNames[i]);
+    }
+
+    if (options.streaming)
+    {
+        std::cout<<"Streaming drop tower file..."<<std::endl;
+        dtReader->StreamDataSurface();
+        std::cout<<"Drop tower file successfully read. Number of points in droptower surface: "<<dtReader->GetSurface()->GetNumberOfPoints()<<std::endl;
 
-    std::cout<<"Reading instron file..."<<std::endl;
-    inReader->ReadHeightFile();
-    inReader->ReadStrainFile();
-    inReader->CreateDataSurface();
-    std::cout<<"Instron file successfully read. Number of points in instron surface: "<<inReader->GetSurface()->GetNumberOfPoints()<<std::endl;
+        std::cout<<"Streaming instron file..."<<std::endl;
+        inReader->StreamDataSurface();
+        std::cout<<"Instron file successfully read. Number of points in instron surface: "<<inReader->GetSurface()->GetNumberOfPoints()<<std::endl;
+    }
+    else
+    {
+        // all four files are independent, so read them at the same time
+        std::cout<<"Reading drop tower and instron files..."<<std::endl;
+        std::vector<ReadDaVis*> readers;
+        readers.push_back(dtReader);
+        readers.push_back(inReader);
+        ReadDaVis::ReadAll(readers);
+
+        dtReader->CreateDataSurface();
+        std::cout<<"Drop tower file successfully read. Number of points in droptower surface: "<<dtReader->GetSurface()->GetNumberOfPoints()<<std::endl;
+        std::cout<<"Parsed at "<<dtReader->GetHeightReadRate()<<" MB/s (height) and "<<dtReader->GetStrainReadRate()<<" MB/s (strain)."<<std::endl;
+
+        inReader->CreateDataSurface();
+        std::cout<<"Instron file successfully read. Number of points in instron surface: "<<inReader->GetSurface()->GetNumberOfPoints()<<std::endl;
+        std::cout<<"Parsed at "<<inReader->GetHeightReadRate()<<" MB/s (height) and "<<inReader->GetStrainReadRate()<<" MB/s (strain)."<<std::endl;
+    }
 
     std::string outPath = argv[5];
     int pathLength = outPath.length();
@@ -77,13 +566,23 @@ int main(int argc, char **argv)
     vtkSmartPointer<vtkXMLPolyDataWriter> dtWriter = vtkSmartPointer<vtkXMLPolyDataWriter>::New();
     dtWriter->SetInput(dtReader->GetSurface());
     dtWriter->SetFileName(dtOutFile.c_str());
-    dtWriter->Write();
-    std::cout<<"Drop tower file successfully written."<<std::endl;
+    ScopedStage dtStage(&timer,"write");
+    if (options.writerSettings.Write(dtWriter,std::cout))
+    {
+        std::cout<<std::endl<<"Drop tower file successfully written."<<std::endl;
+    }
+    dtStage.Stop();
 
     std::cout<<"Writing the instron surface to "<<inOutFile<<std::endl;
     vtkSmartPointer<vtkXMLPolyDataWriter> polyWriter = vtkSmartPointer<vtkXMLPolyDataWriter>::New();
     polyWriter->SetInput(inReader->GetSurface());
     polyWriter->SetFileName(inOutFile.c_str());
-    polyWriter->Write();
-    std::cout<<"Instron file successfully written."<<std::endl;
+    ScopedStage inStage(&timer,"write");
+    if (options.writerSettings.Write(polyWriter,std::cout))
+    {
+        std::cout<<std::endl<<"Instron file successfully written."<<std::endl;
+    }
+    inStage.Stop();
+
+    ReportStages(timer,options.timingFileName);
 }
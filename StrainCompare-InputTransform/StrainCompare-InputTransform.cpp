@@ -23,64 +23,125 @@
 
 
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <map>
 #include "../lib/CompareSurfaces-InputTransform/CompareSurfaces-InputTransform.h"
+#include "../lib/WriterSettings/WriterSettings.h"
+#include "../lib/StageTimer/StageTimer.h"
 #include <vtkSmartPointer.h>
 #include <vtkXMLPolyDataWriter.h>
 #include <vtkXMLUnstructuredGridWriter.h>
+#include <vtkTimerLog.h>
+#include <vtkPolyData.h>
+#include <vtkPointData.h>
+#include <vtkCellArray.h>
+#include <vtkIdTypeArray.h>
 
+namespace
+{
+// the initial values are the translation and the rotation given to SetInitialTransform
+const size_t numberOfInitialValues = 6;
 
-int main(int argc, char **argv)
+/** The options given on the command line, used for every comparison. **/
+struct CompareOptions
+{
+    bool            projection;
+    bool            rigidICP;
+    int             icpIterations;
+    double          icpTolerance;
+    int             icpLandmarks;
+    int             icpLevels;
+    bool            icpPlane;
+    bool            donorCache;
+    bool            binary;
+    WriterSettings  writerSettings;
+    std::string     timingFileName; // the JSON file of the stage times, empty for none
+    StageTimer*     stageTimer;
+};
+
+/** The seconds taken by each stage of a comparison. **/
+struct StageTimes
+{
+    double  read;
+    double  align;
+    double  transfer;
+    double  compile;
+    double  write;
+};
+
+/** Set the options on compare. **/
+void ApplyOptions(CompareSurfaces* compare, const CompareOptions& options)
 {
-    if (argc < 4 || (argc >4 && argc != 10))
+    compare->SetUseRigidICP(options.rigidICP);
+    if (options.icpIterations >= 0)
     {
-        std::cerr<<"### Execution ERROR ###"<<std::endl;
-        std::cerr<<"Not enough inputs. \n Usage:"<<std::endl;
-        std::cerr<<argv[0]<<" [Reciever Surface] [Donor Surface] [Output Path] [Optional Initial Transform]"<<std::endl;
-        std::cerr<<std::endl;
-        std::cerr<<"[Reciever Surface] and [Donor Surface] files must be VTK Polydata files (.vtp). The output will be"<<std::endl;
-        std::cerr<<"an VTK unstructured grid file (strainCompare.vtu) and a text file (strainCompare.txt) containing"<<std::endl;
-        std::cerr<<"the input file names, any initial transform data and the point data."<<std::endl;
-        std::cerr<<"This program assumes that the reciever will be from the drop tower and the donor from the instron."<<std::endl;
-        std::cerr<<std::endl;
-        std::cerr<<"The reciever surface will the aligned to the donor surface and the data from the donor surface"<<std::endl;
-        std::cerr<<"will be transferred to the reciever. The program writes tha two output files files to [Output Path]."<<std::endl;
-        std::cerr<<"strainCompare.vtu will have three point data sets:"<<std::endl;
-        std::cerr<<"""Drop Tower Strain"", ""Instron Strain"" and ""diff"". diff is calculated as (donor (instron) - reciever (drop tower))"<<std::endl;
-        std::cerr<<std::endl;
-        std::cerr<<"The optional initial transform is to roughly align the reciever surface with the donor surface before"<<std::endl;
-        std::cerr<<"the ICP registration, and is not necessary in all cases. If no transform is given then no rough alignment is made."<<std::endl;
-        std::cerr<<"The initial transform must be given as six values the order:"<<std::endl;
-        std::cerr<<"[Translate x] [Translate y] [Translate z] [Rotate x] [Rotate y] [Rotate z]"<<std::endl;
-        std::cerr<<"Thes values can be obtained by manipulating the surfaces in ParaView."<<std::endl;
-        std::cerr<<std::endl<<"### ABORTED ###"<<std::endl;
-        return EXIT_FAILURE;
+        compare->GetRigidICP()->SetMaximumNumberOfIterations(options.icpIterations);
     }
-    CompareSurfaces* compare = new CompareSurfaces;
-    if ( argc == 10)
+    if (options.icpTolerance >= 0)
     {
-        double translate[3] = {atof(argv[4]),atof(argv[5]),atof(argv[6])};
-        double rotate[3] = {atof(argv[7]),atof(argv[8]),atof(argv[9])};
-        compare->SetInitialTransform(translate,rotate);
+        compare->GetRigidICP()->SetTolerance(options.icpTolerance);
+    }
+    if (options.icpLandmarks >= 0)
+    {
+        compare->GetRigidICP()->SetMaximumNumberOfLandmarks(options.icpLandmarks);
+    }
+    if (options.icpLevels >= 0)
+    {
+        compare->GetRigidICP()->SetNumberOfLevels(options.icpLevels);
+    }
+    compare->GetRigidICP()->SetPointToPlane(options.icpPlane);
+    compare->SetDonorCache(options.donorCache);
+    compare->SetStageTimer(options.stageTimer);
+}
 
+/** Set the initial transform of compare from the values given after the
+  * output path, if there are any. **/
+void ApplyInitialValues(CompareSurfaces* compare, const std::vector<double>& values)
+{
+    if (values.size() == numberOfInitialValues)
+    {
+        double translate[3] = {values[0],values[1],values[2]};
+        double rotate[3] = {values[3],values[4],values[5]};
+        compare->SetInitialTransform(translate,rotate);
     }
-	std::cout<<"Reading Drop Tower"<<std::endl;
-	// set and read the dt files
-	compare->GetRecieverReader()->SetFileName(argv[1]);
-	compare->GetRecieverReader()->Update();
-	std::cout<<compare->GetRecieverReader()->GetOutput()->GetNumberOfPoints()<<" Points in Drop Tower Surface."<<std::endl;
+}
 
-    // set and read the intron files
-    std::cout<<"Reading Instron"<<std::endl;
-    compare->GetDonorReader()->SetFileName(argv[2]);
-    compare->GetDonorReader()->Update();
-	std::cout<<compare->GetDonorReader()->GetOutput()->GetNumberOfPoints()<<" Points in Instron Surface."<<std::endl;
+/** Print the time and memory of each stage of the run, and write them to
+  * jsonFileName as well if it is not empty. **/
+void ReportStages(StageTimer& timer, std::string jsonFileName)
+{
+    std::cout<<std::endl;
+    timer.PrintSummary(std::cout);
+    if (!jsonFileName.empty() && !timer.WriteJSON(jsonFileName))
+    {
+        std::cerr<<"Cannot write the stage times to "<<jsonFileName<<std::endl;
+    }
+}
 
-    vtkSmartPointer<vtkPolyData> alignedSurf = compare->AlignSurfaces(compare->GetRecieverReader()->GetOutput(),compare->GetDonorReader()->GetOutput());
+/** Align recieverSurf to donorSurf, move the donor data onto it and write
+  * strainCompare.vtu and strainCompare.txt to outPath, with
+  * strainCompare.bin if options.binary is set. The mesh is written with
+  * options.writerSettings. Each step is reported to log and the time it
+  * took goes in times. Returns false if the mesh can't be written. **/
+bool ComparePair(CompareSurfaces* compare, vtkPolyData* recieverSurf, vtkPolyData* donorSurf, std::string outPath,
+                 const CompareOptions& options, std::ostream& log, StageTimes& times)
+{
+    double stageTime = vtkTimerLog::GetUniversalTime();
+    compare->SetLog(&log);
+    vtkSmartPointer<vtkPolyData> alignedSurf = compare->AlignSurfaces(recieverSurf,donorSurf);
 //    vtkSmartPointer<vtkXMLPolyDataWriter> polyDebugWriter = vtkSmartPointer<vtkXMLPolyDataWriter>::New();
 //    polyDebugWriter->SetInput(alignedSurf);
 //    polyDebugWriter->SetFileName("/home/seth/Desktop/aligned.vtp");
 //    polyDebugWriter->Write();
-    std::cout<<"Surfaces Aligned"<<std::endl;
+    log<<"Surfaces Aligned"<<std::endl;
+    if (options.rigidICP)
+    {
+        log<<"ICP ran "<<compare->GetRigidICP()->GetNumberOfIterations()<<" iterations, RMS distance "<<compare->GetRigidICP()->GetMeanDistance()<<std::endl;
+    }
+    double now = vtkTimerLog::GetUniversalTime();
+    times.align = now - stageTime;
+    stageTime = now;
 
     /* Note that I tried to use the vector from one centroid to the other, but that yeilded bad results,
     often the reviever surface would be tangent to the volume if the centroids were next to each other.
@@ -89,22 +150,34 @@ int main(int argc, char **argv)
     double cent1[3];
     compare->GetSurfaceCentroid(alignedSurf,cent1);
     double cent2[3];
-    compare->GetSurfaceCentroid(compare->GetDonorReader()->GetOutput(),cent2);
+    compare->GetSurfaceCentroid(donorSurf,cent2);
     double extrudeVector[3] = {cent1[0]-cent2[0],cent1[1]-cent2[1],cent1[2]-cent2[2]};*/
     double extrudeVector[3] = {0,0,1};
 
-    compare->ExtrudeSurface(compare->GetDonorReader()->GetOutput(),extrudeVector);
-//    vtkSmartPointer<vtkXMLUnstructuredGridWriter> UgDebugWriter = vtkSmartPointer<vtkXMLUnstructuredGridWriter>::New();
-//    UgDebugWriter->SetInput(compare->GetExtrudedVolume());
-//    UgDebugWriter->SetFileName("/home/seth/Desktop/volume.vtu");
-//    UgDebugWriter->Write();
-    std::cout<<"Surface Extruded"<<std::endl;
+    vtkSmartPointer<vtkPolyData> probeSurf;
+    if (options.projection)
+    {
+        probeSurf = compare->ProjectSurface(donorSurf,alignedSurf,extrudeVector);
+        log<<"Surface Projected"<<std::endl;
+    }
+    else
+    {
+        compare->ExtrudeSurface(donorSurf,extrudeVector);
+//        vtkSmartPointer<vtkXMLUnstructuredGridWriter> UgDebugWriter = vtkSmartPointer<vtkXMLUnstructuredGridWriter>::New();
+//        UgDebugWriter->SetInput(compare->GetExtrudedVolume());
+//        UgDebugWriter->SetFileName("/home/seth/Desktop/volume.vtu");
+//        UgDebugWriter->Write();
+        log<<"Surface Extruded"<<std::endl;
 
-    vtkSmartPointer<vtkPolyData> probeSurf = compare->ProbeVolume(compare->GetExtrudedVolume(),alignedSurf);
-//    polyDebugWriter->SetInput(probeSurf);
-//    polyDebugWriter->SetFileName("/home/seth/Desktop/probed.vtp");
-//    polyDebugWriter->Write();
-    std::cout<<"Volume Probed"<<std::endl;
+        probeSurf = compare->ProbeVolume(compare->GetExtrudedVolume(),alignedSurf);
+//        polyDebugWriter->SetInput(probeSurf);
+//        polyDebugWriter->SetFileName("/home/seth/Desktop/probed.vtp");
+//        polyDebugWriter->Write();
+        log<<"Volume Probed"<<std::endl;
+    }
+    now = vtkTimerLog::GetUniversalTime();
+    times.transfer = now - stageTime;
+    stageTime = now;
 
     std::string donorName = "Instron Strain";
     compare->SetDonorDataName(donorName);
@@ -112,9 +185,11 @@ int main(int argc, char **argv)
     compare->SetRecieverDataName(recieverName);
 
     compare->CompileData(alignedSurf,probeSurf);
-    std::cout<<"Data Compiled"<<std::endl;
+    log<<"Data Compiled"<<std::endl;
+    now = vtkTimerLog::GetUniversalTime();
+    times.compile = now - stageTime;
+    stageTime = now;
 
-    std::string outPath = argv[3];
     int pathLength = outPath.length();
     if (outPath.compare(pathLength-1,1,"/"))
     {
@@ -125,14 +200,563 @@ int main(int argc, char **argv)
     std::string outTextFile = outPath + "strainCompare.txt";
 
     compare->WriteDataToFile(outTextFile);
+    if (options.binary)
+    {
+        compare->WriteDataToBinaryFile(outPath + "strainCompare.bin");
+    }
 
     vtkSmartPointer<vtkXMLUnstructuredGridWriter> writer = vtkSmartPointer<vtkXMLUnstructuredGridWriter>::New();
     writer->SetFileName(outMeshFile.c_str());
     writer->SetInput(compare->GetCompiledData());
-    writer->Write();
-    std::cout<<"Writing Finished"<<std::endl;
+    log<<outMeshFile<<": ";
+    ScopedStage writeStage(options.stageTimer,"write");
+    int written = options.writerSettings.Write(writer,log);
+    writeStage.Stop();
+    times.write = vtkTimerLog::GetUniversalTime() - stageTime;
+    if (!written)
+    {
+        log<<"cannot be written."<<std::endl;
+        return false;
+    }
+    log<<std::endl<<"Writing Finished"<<std::endl;
+    return true;
+}
 
+/** One comparison of a batch manifest. **/
+struct BatchPair
+{
+    int                 line;
+    std::string         reciever;
+    std::string         donor;
+    std::string         output;
+    std::vector<double> initialValues;
+    std::string         error;          // why the line can't be compared, empty if it can
+};
 
-	return 0;
+/** Read the comparisons of a batch manifest, one per line given as the
+  * reciever file, donor file and output path followed by 0 or 6 initial
+  * transform values, separated by commas. Blank lines and lines starting with #
+  * are skipped. Lines that can't be compared are kept with an error.
+  * Returns false if the manifest can't be opened. **/
+bool ReadManifest(std::string fileName, std::vector<BatchPair>& pairs)
+{
+    std::ifstream inFile(fileName.c_str());
+    if (!inFile)
+    {
+        return false;
+    }
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(inFile,line))
+    {
+        ++lineNumber;
+        // split the line at the commas and trim each field
+        std::vector<std::string> fields;
+        std::stringstream lineStream(line);
+        std::string field;
+        while (std::getline(lineStream,field,','))
+        {
+            size_t first = field.find_first_not_of(" \t\r");
+            size_t last = field.find_last_not_of(" \t\r");
+            fields.push_back(first == std::string::npos ? std::string() : field.substr(first,last - first + 1));
+        }
+        if (fields.empty() || (fields.size() == 1 && fields[0].empty()) || !fields[0].compare(0,1,"#"))
+        {
+            continue;
+        }
+
+        BatchPair pair;
+        pair.line = lineNumber;
+        if (fields.size() >= 3)
+        {
+            pair.reciever = fields[0];
+            pair.donor = fields[1];
+            pair.output = fields[2];
+        }
+        for (size_t f = 3; f < fields.size(); ++f)
+        {
+            pair.initialValues.push_back(atof(fields[f].c_str()));
+        }
+        std::stringstream error;
+        if (pair.reciever.empty() || pair.donor.empty() || pair.output.empty())
+        {
+            error<<"Line "<<lineNumber<<" does not give a reciever, donor and output path.";
+        }
+        else if (!pair.initialValues.empty() && pair.initialValues.size() != numberOfInitialValues)
+        {
+            error<<"Line "<<lineNumber<<" has "<<pair.initialValues.size()<<" initial values instead of "<<numberOfInitialValues<<".";
+        }
+        pair.error = error.str();
+        pairs.push_back(pair);
+    }
+    return true;
 }
 
+/** A new array of the type, name and components of array that uses its
+  * values in place. array keeps ownership of the values. **/
+vtkSmartPointer<vtkDataArray> NewSharedArray(vtkDataArray* array)
+{
+    vtkSmartPointer<vtkDataArray> shared;
+    shared.TakeReference(array->NewInstance());
+    shared->SetNumberOfComponents(array->GetNumberOfComponents());
+    shared->SetName(array->GetName());
+    vtkIdType size = array->GetNumberOfTuples()*array->GetNumberOfComponents();
+    shared->SetVoidArray(size > 0 ? array->GetVoidPointer(0) : 0,size,1);
+    return shared;
+}
+
+/** A new cell array of the cells of cells that uses its connectivity in
+  * place. **/
+vtkSmartPointer<vtkCellArray> NewSharedCells(vtkCellArray* cells)
+{
+    vtkIdTypeArray* data = cells->GetData();
+    vtkIdType size = data->GetNumberOfTuples();
+    vtkSmartPointer<vtkIdTypeArray> ids = vtkSmartPointer<vtkIdTypeArray>::New();
+    ids->SetArray(size > 0 ? data->GetPointer(0) : 0,size,1);
+    vtkSmartPointer<vtkCellArray> shared = vtkSmartPointer<vtkCellArray>::New();
+    shared->SetCells(cells->GetNumberOfCells(),ids);
+    return shared;
+}
+
+/** A new surface with the points, cells and point data of surface used in
+  * place rather than copied. Every VTK object of it is new, so no object
+  * is shared, and no reference count changed, between the threads using
+  * surface. surface must outlive it and must not be changed. **/
+vtkSmartPointer<vtkPolyData> NewSharedSurface(vtkPolyData* surface)
+{
+    vtkSmartPointer<vtkPolyData> shared = vtkSmartPointer<vtkPolyData>::New();
+    vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+    points->SetData(NewSharedArray(surface->GetPoints()->GetData()));
+    shared->SetPoints(points);
+    if (surface->GetNumberOfVerts() > 0)
+    {
+        shared->SetVerts(NewSharedCells(surface->GetVerts()));
+    }
+    if (surface->GetNumberOfLines() > 0)
+    {
+        shared->SetLines(NewSharedCells(surface->GetLines()));
+    }
+    if (surface->GetNumberOfPolys() > 0)
+    {
+        shared->SetPolys(NewSharedCells(surface->GetPolys()));
+    }
+    if (surface->GetNumberOfStrips() > 0)
+    {
+        shared->SetStrips(NewSharedCells(surface->GetStrips()));
+    }
+    vtkPointData* pointData = surface->GetPointData();
+    for (int k = 0; k < pointData->GetNumberOfArrays(); ++k)
+    {
+        if (pointData->GetArray(k))
+        {
+            shared->GetPointData()->AddArray(NewSharedArray(pointData->GetArray(k)));
+        }
+    }
+    if (pointData->GetScalars())
+    {
+        shared->GetPointData()->SetActiveScalars(pointData->GetScalars()->GetName());
+    }
+    return shared;
+}
+
+/** The donor surfaces of a batch. Each is read once, by the first
+  * comparison to need it, and kept until the end of the batch. The
+  * comparisons only read the donor, so each is given a surface that
+  * uses the stored points, cells and data in place. Only with --icp or
+  * --project is each given a deep copy, costing the memory of one donor
+  * per pair in flight. **/
+class DonorStore
+{
+public:
+    ~DonorStore()
+    {
+        for (std::map<std::string,DonorEntry*>::iterator donor = m_donors.begin(); donor != m_donors.end(); ++donor)
+        {
+            delete donor->second;
+        }
+    }
+
+    /** The donor surface in fileName, sharing the stored surface or as a
+      * deep copy of it, or null if it can't be read or has no points. The
+      * read is added to timer as "parse". **/
+    vtkSmartPointer<vtkPolyData> GetCopy(std::string fileName, StageTimer* timer, bool deepCopy)
+    {
+        m_lock.Lock();
+        DonorEntry*& entry = m_donors[fileName];
+        if (!entry)
+        {
+            entry = new DonorEntry;
+        }
+        m_lock.Unlock();
+
+        // each donor has its own lock, so reading one doesn't hold up the others
+        vtkSmartPointer<vtkPolyData> copy;
+        entry->lock.Lock();
+        if (!entry->read)
+        {
+            entry->read = true;
+            vtkSmartPointer<vtkXMLPolyDataReader> reader = vtkSmartPointer<vtkXMLPolyDataReader>::New();
+            if (reader->CanReadFile(fileName.c_str()))
+            {
+                reader->SetFileName(fileName.c_str());
+                ScopedStage stage(timer,"parse");
+                reader->Update();
+                stage.Stop();
+                if (reader->GetOutput()->GetNumberOfPoints() > 0)
+                {
+                    entry->surface = vtkSmartPointer<vtkPolyData>::New();
+                    entry->surface->ShallowCopy(reader->GetOutput());
+                }
+            }
+        }
+        if (entry->surface && deepCopy)
+        {
+            copy = vtkSmartPointer<vtkPolyData>::New();
+            copy->DeepCopy(entry->surface);
+        }
+        else if (entry->surface)
+        {
+            copy = NewSharedSurface(entry->surface);
+        }
+        entry->lock.Unlock();
+        return copy;
+    }
+
+private:
+    struct DonorEntry
+    {
+        DonorEntry() : read(false) {}
+        vtkSimpleCriticalSection        lock;
+        bool                            read;
+        vtkSmartPointer<vtkPolyData>    surface;
+    };
+
+    vtkSimpleCriticalSection            m_lock;
+    std::map<std::string,DonorEntry*>   m_donors;
+};
+
+/** Runs the comparisons of a batch, one per item, and reports each as it
+  * finishes. A comparison that fails is reported and the rest go on. **/
+class BatchJobs : public ParallelRangeFunctor
+{
+public:
+    BatchJobs(const std::vector<BatchPair>& pairs, const CompareOptions& options, int threadsPerPair)
+        : m_pairs(pairs), m_options(options), m_threadsPerPair(threadsPerPair)
+    {
+        m_numberOfFinishedPairs = 0;
+        m_numberOfFailures = 0;
+    }
+
+    void Execute(vtkIdType begin, vtkIdType end, int)
+    {
+        for (vtkIdType k = begin; k < end; ++k)
+        {
+            RunPair(m_pairs[k]);
+        }
+    }
+
+    int GetNumberOfFailures()
+    {
+        return m_numberOfFailures;
+    }
+
+private:
+    void RunPair(const BatchPair& pair)
+    {
+        StageTimes times = {0,0,0,0,0};
+        std::stringstream log;
+        std::string error = pair.error;
+        double startTime = vtkTimerLog::GetUniversalTime();
+        if (error.empty())
+        {
+            try
+            {
+                ComparePairFiles(pair,times,log,error);
+            }
+            catch (std::exception& exception)
+            {
+                error = exception.what();
+            }
+        }
+        double seconds = vtkTimerLog::GetUniversalTime() - startTime;
+
+        // report the whole pair at once so the lines of different pairs aren't mixed
+        m_lock.Lock();
+        ++m_numberOfFinishedPairs;
+        std::cout<<"["<<m_numberOfFinishedPairs<<"/"<<m_pairs.size()<<"] ";
+        std::cout<<(pair.reciever.empty() ? "Manifest line" : pair.reciever)<<" to "<<pair.donor<<": ";
+        if (error.empty())
+        {
+            std::cout<<"done in "<<seconds<<" s (read "<<times.read<<", align "<<times.align<<", transfer "<<times.transfer<<
+                       ", compile "<<times.compile<<", write "<<times.write<<")"<<std::endl;
+        }
+        else
+        {
+            ++m_numberOfFailures;
+            std::cout<<"FAILED after "<<seconds<<" s. "<<error<<std::endl<<log.str();
+        }
+        m_lock.Unlock();
+    }
+
+    /** Read the surfaces of pair and compare them. error is set if they
+      * can't be compared. **/
+    void ComparePairFiles(const BatchPair& pair, StageTimes& times, std::ostream& log, std::string& error)
+    {
+        double startTime = vtkTimerLog::GetUniversalTime();
+        CompareSurfaces compare;
+        ApplyOptions(&compare,m_options);
+        compare.SetNumberOfThreads(m_threadsPerPair);
+        ApplyInitialValues(&compare,pair.initialValues);
+
+        vtkXMLPolyDataReader* recieverReader = compare.GetRecieverReader();
+        if (!recieverReader->CanReadFile(pair.reciever.c_str()))
+        {
+            error = "Cannot read the reciever surface " + pair.reciever;
+            return;
+        }
+        recieverReader->SetFileName(pair.reciever.c_str());
+        ScopedStage parseStage(m_options.stageTimer,"parse");
+        recieverReader->Update();
+        parseStage.Stop();
+        log<<recieverReader->GetOutput()->GetNumberOfPoints()<<" Points in Drop Tower Surface."<<std::endl;
+        vtkSmartPointer<vtkPolyData> donorSurf = m_donors.GetCopy(pair.donor,m_options.stageTimer,
+                                                                   m_options.rigidICP || m_options.projection);
+        if (!donorSurf)
+        {
+            error = "Cannot read the donor surface " + pair.donor;
+            return;
+        }
+        log<<donorSurf->GetNumberOfPoints()<<" Points in Instron Surface."<<std::endl;
+        compare.SetDonorCacheSource(donorSurf,pair.donor);
+        // the donor is read by the store, but its name is still written to the text file
+        compare.GetDonorReader()->SetFileName(pair.donor.c_str());
+        times.read = vtkTimerLog::GetUniversalTime() - startTime;
+
+        if (!ComparePair(&compare,recieverReader->GetOutput(),donorSurf,pair.output,m_options,log,times))
+        {
+            error = "Cannot write the output to " + pair.output;
+        }
+    }
+
+    const std::vector<BatchPair>&   m_pairs;
+    const CompareOptions&           m_options;
+    int                             m_threadsPerPair;
+    DonorStore                      m_donors;
+    vtkSimpleCriticalSection        m_lock;
+    int                             m_numberOfFinishedPairs;
+    int                             m_numberOfFailures;
+};
+
+/** Compare every pair of the manifest, up to numberOfPairThreads at once,
+  * sharing the processors between them. Returns EXIT_FAILURE if any pair
+  * failed. **/
+int RunBatch(std::string manifestFileName, const CompareOptions& options, int numberOfPairThreads)
+{
+    std::vector<BatchPair> pairs;
+    if (!ReadManifest(manifestFileName,pairs))
+    {
+        std::cerr<<"Cannot open the batch manifest "<<manifestFileName<<std::endl;
+        return EXIT_FAILURE;
+    }
+    if (pairs.empty())
+    {
+        std::cout<<"No pairs in "<<manifestFileName<<std::endl;
+        return 0;
+    }
+
+    // the pairs are handed out one at a time, so a slow pair doesn't hold up the rest
+    int numberOfProcessors = ParallelRange::GetNumberOfThreads(0);
+    numberOfPairThreads = ParallelRange::GetNumberOfThreads(numberOfPairThreads);
+    numberOfPairThreads = (static_cast<size_t>(numberOfPairThreads) > pairs.size()) ? pairs.size() : numberOfPairThreads;
+    int threadsPerPair = numberOfProcessors/numberOfPairThreads;
+    threadsPerPair = (threadsPerPair < 1) ? 1 : threadsPerPair;
+    std::cout<<"Comparing "<<pairs.size()<<" pairs, "<<numberOfPairThreads<<" at a time"<<std::endl;
+
+    double startTime = vtkTimerLog::GetUniversalTime();
+    BatchJobs jobs(pairs,options,threadsPerPair);
+    ParallelRange::Execute(pairs.size(),&jobs,1,numberOfPairThreads);
+    std::cout<<pairs.size() - jobs.GetNumberOfFailures()<<" of "<<pairs.size()<<" pairs compared in "<<
+               vtkTimerLog::GetUniversalTime() - startTime<<" s"<<std::endl;
+    return (jobs.GetNumberOfFailures() == 0) ? 0 : EXIT_FAILURE;
+}
+}
+
+int main(int argc, char **argv)
+{
+    // options start with "--" and may be given anywhere, everything else is positional
+    std::vector<std::string> arguments;
+    CompareOptions options;
+    options.projection = false;
+    options.rigidICP = false;
+    options.icpIterations = -1;
+    options.icpTolerance = -1;
+    options.icpLandmarks = -1;
+    options.icpLevels = -1;
+    options.icpPlane = false;
+    options.donorCache = false;
+    options.binary = false;
+    StageTimer timer;
+    options.stageTimer = &timer;
+    std::string batchFileName;
+    int batchPairs = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string argument = argv[i];
+        int used = options.writerSettings.ParseOption(argc,argv,i);
+        if (used > 0)
+        {
+            i += used - 1;
+        }
+        else if (argument.compare(0,2,"--"))
+        {
+            arguments.push_back(argument);
+        }
+        else if (argument == "--project")
+        {
+            options.projection = true;
+        }
+        else if (argument == "--icp")
+        {
+            options.rigidICP = true;
+        }
+        else if (argument == "--icp-iterations" && i + 1 < argc)
+        {
+            options.icpIterations = atoi(argv[++i]);
+        }
+        else if (argument == "--icp-tolerance" && i + 1 < argc)
+        {
+            options.icpTolerance = atof(argv[++i]);
+        }
+        else if (argument == "--icp-landmarks" && i + 1 < argc)
+        {
+            options.icpLandmarks = atoi(argv[++i]);
+        }
+        else if (argument == "--icp-levels" && i + 1 < argc)
+        {
+            options.icpLevels = atoi(argv[++i]);
+        }
+        else if (argument == "--icp-plane")
+        {
+            options.icpPlane = true;
+        }
+        else if (argument == "--donor-cache")
+        {
+            options.donorCache = true;
+        }
+        else if (argument == "--binary")
+        {
+            options.binary = true;
+        }
+        else if (argument == "--timing-json" && i + 1 < argc)
+        {
+            options.timingFileName = argv[++i];
+        }
+        else if (argument == "--batch" && i + 1 < argc)
+        {
+            batchFileName = argv[++i];
+        }
+        else if (argument == "--batch-pairs" && i + 1 < argc)
+        {
+            batchPairs = atoi(argv[++i]);
+        }
+        else
+        {
+            std::cout<<"Unknown option "<<argument<<" ignored."<<std::endl;
+        }
+    }
+
+    if (!batchFileName.empty())
+    {
+        if (!arguments.empty())
+        {
+            std::cout<<"The surfaces and output path are given by the manifest, positional inputs are ignored."<<std::endl;
+        }
+        int result = RunBatch(batchFileName,options,batchPairs);
+        ReportStages(timer,options.timingFileName);
+        return result;
+    }
+
+    if (arguments.size() < 3 || (arguments.size() > 3 && arguments.size() != 9))
+    {
+        std::cerr<<"### Execution ERROR ###"<<std::endl;
+        std::cerr<<"Not enough inputs. \n Usage:"<<std::endl;
+        std::cerr<<argv[0]<<" [Reciever Surface] [Donor Surface] [Output Path] [Optional Initial Transform] [Options]"<<std::endl;
+        std::cerr<<argv[0]<<" --batch [Manifest] [Options]"<<std::endl;
+        std::cerr<<std::endl;
+        std::cerr<<"[Reciever Surface] and [Donor Surface] files must be VTK Polydata files (.vtp). The output will be"<<std::endl;
+        std::cerr<<"an VTK unstructured grid file (strainCompare.vtu) and a text file (strainCompare.txt) containing"<<std::endl;
+        std::cerr<<"the input file names, any initial transform data and the point data."<<std::endl;
+        std::cerr<<"This program assumes that the reciever will be from the drop tower and the donor from the instron."<<std::endl;
+        std::cerr<<std::endl;
+        std::cerr<<"The reciever surface will the aligned to the donor surface and the data from the donor surface"<<std::endl;
+        std::cerr<<"will be transferred to the reciever. The program writes tha two output files files to [Output Path]."<<std::endl;
+        std::cerr<<"strainCompare.vtu will have three point data sets:"<<std::endl;
+        std::cerr<<"""Drop Tower Strain"", ""Instron Strain"" and ""diff"". diff is calculated as (donor (instron) - reciever (drop tower))"<<std::endl;
+        std::cerr<<std::endl;
+        std::cerr<<"The optional initial transform is to roughly align the reciever surface with the donor surface before"<<std::endl;
+        std::cerr<<"the ICP registration, and is not necessary in all cases. If no transform is given then no rough alignment is made."<<std::endl;
+        std::cerr<<"The initial transform must be given as six values the order:"<<std::endl;
+        std::cerr<<"[Translate x] [Translate y] [Translate z] [Rotate x] [Rotate y] [Rotate z]"<<std::endl;
+        std::cerr<<"Thes values can be obtained by manipulating the surfaces in ParaView."<<std::endl;
+        std::cerr<<std::endl;
+        std::cerr<<"Each line of a batch manifest is [Reciever Surface],[Donor Surface],[Output Path] followed by"<<std::endl;
+        std::cerr<<"0 or 6 initial transform values, separated by commas. Lines starting with # are skipped."<<std::endl;
+        std::cerr<<std::endl;
+        std::cerr<<"Options:"<<std::endl;
+        std::cerr<<"  --project  Project the reciever points onto the donor triangles instead of probing an extruded volume."<<std::endl;
+        std::cerr<<"  --icp      Align with the k-d tree ICP engine instead of vtkIterativeClosestPointTransform."<<std::endl;
+        std::cerr<<"  --icp-iterations [N]  The most ICP iterations. The default is 50."<<std::endl;
+        std::cerr<<"  --icp-tolerance [D]   Stop once the points move less than D in an iteration. The default is 0.001."<<std::endl;
+        std::cerr<<"  --icp-landmarks [N]   The most points matched each iteration, 0 for all. The default is 200."<<std::endl;
+        std::cerr<<"  --icp-levels [N]      Align coarse to fine over N levels, each with a quarter of the points of the last."<<std::endl;
+        std::cerr<<"  --icp-plane           Minimise the distances to the target triangle planes instead of to the matched points."<<std::endl;
+        std::cerr<<"  --donor-cache         Keep what is built from the Instron surface in cache files next to it, for later runs."<<std::endl;
+        std::cerr<<"  --binary              Also write strainCompare.bin, the columns of strainCompare.txt as memory mappable doubles."<<std::endl;
+        std::cerr<<"  --timing-json [File]  Write the time and peak memory of each stage, printed at the end of the run, to File as JSON."<<std::endl;
+        std::cerr<<"  --batch [Manifest]    Compare every pair of surfaces listed in the manifest. Each donor surface is read once."<<std::endl;
+        std::cerr<<"                        With --icp or --project each pair in flight holds its own copy of its donor surface."<<std::endl;
+        std::cerr<<"  --batch-pairs [N]     The most pairs compared at once in a batch. The default of 0 uses every processor."<<std::endl;
+        WriterSettings::PrintOptions(std::cerr);
+        std::cerr<<std::endl<<"### ABORTED ###"<<std::endl;
+        return EXIT_FAILURE;
+    }
+    CompareSurfaces* compare = new CompareSurfaces;
+    ApplyOptions(compare,options);
+    if ( arguments.size() == 9)
+    {
+        std::vector<double> initialValues;
+        for (size_t a = 3; a < arguments.size(); ++a)
+        {
+            initialValues.push_back(atof(arguments[a].c_str()));
+        }
+        ApplyInitialValues(compare,initialValues);
+
+    }
+	std::cout<<"Reading Drop Tower"<<std::endl;
+	// set and read the dt files
+	compare->GetRecieverReader()->SetFileName(arguments[0].c_str());
+    ScopedStage recieverStage(&timer,"parse");
+	compare->GetRecieverReader()->Update();
+    recieverStage.Stop();
+	std::cout<<compare->GetRecieverReader()->GetOutput()->GetNumberOfPoints()<<" Points in Drop Tower Surface."<<std::endl;
+
+    // set and read the intron files
+    std::cout<<"Reading Instron"<<std::endl;
+    compare->GetDonorReader()->SetFileName(arguments[1].c_str());
+    ScopedStage donorStage(&timer,"parse");
+    compare->GetDonorReader()->Update();
+    donorStage.Stop();
+	std::cout<<compare->GetDonorReader()->GetOutput()->GetNumberOfPoints()<<" Points in Instron Surface."<<std::endl;
+
+    StageTimes times;
+    bool compared = ComparePair(compare,compare->GetRecieverReader()->GetOutput(),compare->GetDonorReader()->GetOutput(),
+                                arguments[2],options,std::cout,times);
+    ReportStages(timer,options.timingFileName);
+    if (!compared)
+    {
+        return EXIT_FAILURE;
+    }
+
+
+	return 0;
+}
@@ -0,0 +1,227 @@
+/*
+ * BinaryCache.cpp
+ *
+ * Copyright 2013 Seth Gilchrist <seth@fake.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#include "BinaryCache.h"
+#include <cstring>
+#include <sstream>
+#include <iostream>
+#include <boost/filesystem.hpp>
+
+namespace
+{
+/** The start of a cache file. **/
+struct BinaryCacheHeader
+{
+    char            magic[8];
+    boost::uint32_t version;
+    boost::uint32_t reserved;
+    boost::uint64_t key;
+};
+
+/** The start of each array. **/
+struct BinaryCacheArray
+{
+    boost::uint64_t length;
+    boost::uint64_t elementSize;
+};
+
+const char cacheMagic[8] = {'S','C','A','C','H','E','0','1'};
+const boost::uint32_t cacheVersion = 1;
+
+/** The bytes an array of size bytes takes, padded to 8. **/
+inline size_t PaddedSize(size_t size)
+{
+    return (size + 7)/8*8;
+}
+}
+
+boost::uint64_t BinaryCache::GetInitialHash()
+{
+    return UINT64_C(14695981039346656037);
+}
+
+boost::uint64_t BinaryCache::HashBytes(const void* data, size_t size, boost::uint64_t hash)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= UINT64_C(1099511628211);
+    }
+    return hash;
+}
+
+bool BinaryCache::HashFile(std::string fileName, boost::uint64_t& hash)
+{
+    boost::iostreams::mapped_file_source file;
+    try
+    {
+        file.open(fileName);
+    }
+    catch (std::exception&)
+    {
+        return false;
+    }
+    if (!file.is_open())
+    {
+        return false;
+    }
+    hash = HashBytes(file.data(),file.size(),hash);
+    return true;
+}
+
+BinaryCacheWriter::BinaryCacheWriter(std::string fileName, boost::uint64_t key)
+{
+    m_fileName = fileName;
+    m_committed = false;
+    std::stringstream tempFileName;
+    tempFileName << fileName << ".tmp" << this;
+    m_tempFileName = tempFileName.str();
+    m_file.open(m_tempFileName.c_str(),std::ios::binary | std::ios::trunc);
+
+    BinaryCacheHeader header;
+    memset(&header,0,sizeof(header));
+    memcpy(header.magic,cacheMagic,sizeof(header.magic));
+    header.version = cacheVersion;
+    header.key = key;
+    m_file.write(reinterpret_cast<const char*>(&header),sizeof(header));
+}
+
+BinaryCacheWriter::~BinaryCacheWriter()
+{
+    if (!m_committed)
+    {
+        m_file.close();
+        boost::system::error_code error;
+        boost::filesystem::remove(m_tempFileName,error);
+    }
+}
+
+void BinaryCacheWriter::WriteBytes(const void* values, size_t n, size_t elementSize)
+{
+    BinaryCacheArray array;
+    array.length = n;
+    array.elementSize = elementSize;
+    m_file.write(reinterpret_cast<const char*>(&array),sizeof(array));
+    size_t size = n*elementSize;
+    if (size > 0)
+    {
+        m_file.write(static_cast<const char*>(values),size);
+    }
+    const char padding[8] = {0,0,0,0,0,0,0,0};
+    m_file.write(padding,PaddedSize(size) - size);
+}
+
+bool BinaryCacheWriter::Commit()
+{
+    m_file.close();
+    m_committed = true;
+    boost::system::error_code error;
+    if (m_file.fail())
+    {
+        std::cerr << "Cannot write the cache file " << m_fileName << std::endl;
+        boost::filesystem::remove(m_tempFileName,error);
+        return false;
+    }
+    boost::filesystem::rename(m_tempFileName,m_fileName,error);
+    if (error)
+    {
+        boost::filesystem::remove(m_tempFileName,error);
+        return false;
+    }
+    return true;
+}
+
+BinaryCacheReader::BinaryCacheReader()
+{
+    m_position = 0;
+    m_end = 0;
+}
+
+bool BinaryCacheReader::Open(std::string fileName, boost::uint64_t key)
+{
+    m_position = 0;
+    m_end = 0;
+    // let go of any mapping shared with a GetFile() copy rather than reopen it
+    m_file = boost::iostreams::mapped_file();
+    try
+    {
+        boost::iostreams::mapped_file_params params(fileName);
+        params.flags = boost::iostreams::mapped_file::priv;
+        m_file.open(params);
+    }
+    catch (std::exception&)
+    {
+        return false;
+    }
+    if (!m_file.is_open() || m_file.size() < sizeof(BinaryCacheHeader))
+    {
+        return false;
+    }
+
+    // check the cache was written by this version for the same key
+    BinaryCacheHeader header;
+    memcpy(&header,m_file.const_data(),sizeof(header));
+    if (memcmp(header.magic,cacheMagic,sizeof(header.magic)) != 0 || header.version != cacheVersion ||
+        header.key != key)
+    {
+        m_file.close();
+        return false;
+    }
+    m_position = m_file.const_data() + sizeof(header);
+    m_end = m_file.const_data() + m_file.size();
+    return true;
+}
+
+size_t BinaryCacheReader::NextArraySize(size_t elementSize)
+{
+    if (!m_position || static_cast<size_t>(m_end - m_position) < sizeof(BinaryCacheArray))
+    {
+        return static_cast<size_t>(-1);
+    }
+    BinaryCacheArray array;
+    memcpy(&array,m_position,sizeof(array));
+    size_t available = (m_end - m_position) - sizeof(array);
+    if (array.elementSize != elementSize || array.length > available/elementSize)
+    {
+        return static_cast<size_t>(-1);
+    }
+    return array.length;
+}
+
+const char* BinaryCacheReader::ReadBytes(size_t n, size_t elementSize)
+{
+    if (NextArraySize(elementSize) != n)
+    {
+        return 0;
+    }
+    const char* data = m_position + sizeof(BinaryCacheArray);
+    size_t size = PaddedSize(n*elementSize);
+    m_position = (static_cast<size_t>(m_end - data) < size) ? m_end : data + size;
+    return data;
+}
+
+bool BinaryCacheReader::AtEnd()
+{
+    return m_position == m_end;
+}
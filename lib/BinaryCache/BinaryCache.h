@@ -0,0 +1,157 @@
+/*
+ * BinaryCache.h
+ *
+ * Copyright 2013 Seth Gilchrist <seth@fake.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#ifndef BINARYCACHE_H
+#define BINARYCACHE_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <boost/cstdint.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+/** Hashes for keying a cache on what it was built from. Both are 64 bit
+  * FNV-1a and carry on from hash, so a file and the parameters it was
+  * used with can be hashed into one key. **/
+class BinaryCache
+{
+public:
+    /** The hash of nothing, to start from. **/
+    static boost::uint64_t GetInitialHash();
+    /** Hash size bytes at data. **/
+    static boost::uint64_t HashBytes( const void* data, size_t size, boost::uint64_t hash );
+    /** Hash the content of fileName, which is mapped rather than read.
+      * Returns false if the file can't be mapped. **/
+    static bool HashFile( std::string fileName, boost::uint64_t& hash );
+};
+
+/** Writes a cache file of flat arrays. The file starts with a header
+  * holding the key, then each array is its length, its element size and
+  * its raw values in the native byte order, padded to 8 bytes so every
+  * array of the mapped file is aligned. The file is written to a
+  * temporary name and only appears under its own name on Commit, so a
+  * reader never maps a half written cache. **/
+class BinaryCacheWriter
+{
+public:
+    BinaryCacheWriter( std::string fileName, boost::uint64_t key );
+    /** Removes the temporary file if Commit was not called. **/
+    ~BinaryCacheWriter();
+
+    /** Write n values as one array. **/
+    template <class T>
+    void Write( const T* values, size_t n )
+    {
+        WriteBytes(values,n,sizeof(T));
+    }
+    template <class T>
+    void Write( const std::vector<T>& values )
+    {
+        WriteBytes(values.empty() ? 0 : &values[0],values.size(),sizeof(T));
+    }
+
+    /** Move the finished file to its name. Returns false, and writes
+      * nothing under the name, if any write failed. **/
+    bool Commit();
+
+private:
+    void WriteBytes( const void* values, size_t n, size_t elementSize );
+
+    std::string     m_fileName;
+    std::string     m_tempFileName;
+    std::ofstream   m_file;
+    bool            m_committed;
+};
+
+/** Reads a cache file written by BinaryCacheWriter. The file is mapped
+  * copy on write and each Read copies the next array out of it, in the
+  * order they were written, or Map hands it out in place. **/
+class BinaryCacheReader
+{
+public:
+    BinaryCacheReader();
+
+    /** Map fileName. Returns false if it can't be mapped or was not
+      * written by this version with the given key. **/
+    bool Open( std::string fileName, boost::uint64_t key );
+
+    /** Read the next array into values, which must hold exactly n.
+      * Returns false if the next array is not n values of type T. **/
+    template <class T>
+    bool Read( T* values, size_t n )
+    {
+        const char* data = ReadBytes(n,sizeof(T));
+        if (!data)
+        {
+            return false;
+        }
+        std::copy(data,data + n*sizeof(T),reinterpret_cast<char*>(values));
+        return true;
+    }
+    /** Read the next array into values, resized to fit. **/
+    template <class T>
+    bool Read( std::vector<T>& values )
+    {
+        size_t n = NextArraySize(sizeof(T));
+        if (n == static_cast<size_t>(-1))
+        {
+            return false;
+        }
+        values.resize(n);
+        return n == 0 ? ReadBytes(0,sizeof(T)) != 0 : Read(&values[0],n);
+    }
+
+    /** The next array, which must be n values of type T, left in the
+      * mapped file rather than copied. Returns 0 if it is not n values
+      * of type T. The values may be changed without changing the file,
+      * and stay valid while the reader, or a copy of GetFile(), is kept. **/
+    template <class T>
+    T* Map( size_t n )
+    {
+        return reinterpret_cast<T*>(const_cast<char*>(ReadBytes(n,sizeof(T))));
+    }
+    /** The mapped file. Copies share the mapping, which is closed once
+      * the reader and every copy are gone. **/
+    boost::iostreams::mapped_file GetFile()
+    {
+        return m_file;
+    }
+
+    /** Whether every array has been read. **/
+    bool AtEnd();
+
+private:
+    /** The length of the next array, or -1 if there is none or its
+      * elements are not elementSize bytes. **/
+    size_t NextArraySize( size_t elementSize );
+    /** The values of the next array, which must be n values of
+      * elementSize bytes, and step past it. Returns 0 if it is not. **/
+    const char* ReadBytes( size_t n, size_t elementSize );
+
+    boost::iostreams::mapped_file           m_file;
+    const char*                             m_position;
+    const char*                             m_end;
+};
+
+#endif // BINARYCACHE_H
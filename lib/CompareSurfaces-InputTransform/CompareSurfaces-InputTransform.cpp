@@ -23,6 +23,628 @@
 
 #include "CompareSurfaces-InputTransform.h"
 
+namespace
+{
+/** Fills the points and wedges of ExtrudeSurface. The Points stage is run
+  * over the surface points and writes each point and its child point, the
+  * Wedges stage is run over the surface triangles. **/
+template <class T>
+class ExtrusionBuilder : public ParallelRangeFunctor
+{
+public:
+    enum Stage {Points, Wedges};
+
+    void Execute(vtkIdType begin, vtkIdType end, int)
+    {
+        if (stage == Points)
+        {
+            for (vtkIdType i = begin; i < end; ++i)
+            {
+                for (int c = 0; c < 3; ++c)
+                {
+                    // the surface is moved back by vect and the child point is 2*vect in front
+                    T parent = static_cast<T>(surfacePoints[3*i+c] - vect[c]);
+                    points[3*i+c] = parent;
+                    points[3*(i+numberOfPoints)+c] = static_cast<T>(parent + 2*vect[c]);
+                }
+            }
+            return;
+        }
+        for (vtkIdType i = begin; i < end; ++i)
+        {
+            // the wedge is the triangle plus the child point of each of its points
+            const vtkIdType* triangle = polys + triangleLocations[i] + 1;
+            vtkIdType* wedge = cells + 7*i;
+            wedge[0] = 6;
+            wedge[1] = triangle[0];
+            wedge[2] = triangle[1];
+            wedge[3] = triangle[2];
+            wedge[4] = triangle[0] + numberOfPoints;
+            wedge[5] = triangle[1] + numberOfPoints;
+            wedge[6] = triangle[2] + numberOfPoints;
+            locations[i] = 7*i;
+        }
+    }
+
+    Stage               stage;
+    vtkIdType           numberOfPoints;
+    double              vect[3];
+    const T*            surfacePoints;
+    T*                  points;
+    const vtkIdType*    polys;
+    const vtkIdType*    triangleLocations;
+    vtkIdType*          cells;
+    vtkIdType*          locations;
+};
+
+/** Write the extruded points of the n surface points into points. **/
+template <class T>
+void ExtrudePoints(const T* surfacePoints, T* points, vtkIdType n, double vect[3], int numberOfThreads)
+{
+    ExtrusionBuilder<T> builder;
+    builder.stage = ExtrusionBuilder<T>::Points;
+    builder.numberOfPoints = n;
+    builder.vect[0] = vect[0];
+    builder.vect[1] = vect[1];
+    builder.vect[2] = vect[2];
+    builder.surfacePoints = surfacePoints;
+    builder.points = points;
+    ParallelRange::Execute(n,&builder,0,numberOfThreads);
+}
+
+/** Probes the points of a surface in a volume of wedges. The locator
+  * fills in the containing cell and its weights, so each thread has its
+  * own cell and weights to hand it. **/
+class VolumeProber : public ParallelRangeFunctor
+{
+public:
+    VolumeProber(vtkCellLocator* locator, vtkPolyData* surface, const std::vector<vtkDataArray*>& volumeArrays,
+                 const std::vector<vtkSmartPointer<vtkDataArray> >& newArrays, int numberOfThreads)
+        : m_locator(locator), m_surface(surface), m_volumeArrays(volumeArrays), m_newArrays(newArrays),
+          m_weights(numberOfThreads*VTK_CELL_SIZE)
+    {
+        for (int t = 0; t < numberOfThreads; ++t)
+        {
+            m_cells.push_back(vtkSmartPointer<vtkGenericCell>::New());
+        }
+    }
+
+    void Execute(vtkIdType begin, vtkIdType end, int threadId)
+    {
+        vtkGenericCell* cell = m_cells[threadId];
+        double* weights = &m_weights[threadId*VTK_CELL_SIZE];
+        double blankTuple = -1000000.;
+        double cPoint[3];
+        double pcoords[3];
+        double cellData[6];
+        double cValue;
+        for (vtkIdType i = begin; i < end; ++i)
+        {
+            // get the point location
+            m_surface->GetPoint(i,cPoint);
+            // find the cell that contains the point and the interpolation function weight values
+            vtkIdType cCellNo = m_locator->FindCell(cPoint,0,cell,pcoords,weights);
+            // if the point is outside of the wedges, enter the blank value in the data arrays
+            if (cCellNo == -1 || cell->GetCellType() != VTK_WEDGE)
+            {
+                for (size_t k = 0; k < m_newArrays.size(); ++k)
+                {
+                    m_newArrays[k]->SetTuple(i,&blankTuple);
+                }
+                continue;
+            }
+            // get the point IDs that define the containing cell
+            vtkIdList* cellPoints = cell->GetPointIds();
+
+            // the same cell and weights interpolate every array
+            for (size_t k = 0; k < m_newArrays.size(); ++k)
+            {
+                // get the strain values for each point in the containing cell
+                for (int p = 0; p < 6; ++p)
+                {
+                    cellData[p] = m_volumeArrays[k]->GetComponent(cellPoints->GetId(p),0);
+                }
+                // calculate the value at the point by multiplying each weight by the data
+                cValue = cellData[0]*weights[0] + cellData[1]*weights[1] + cellData[2]*weights[2] + cellData[3]*weights[3] + cellData[4]*weights[4] + cellData[5]*weights[5];
+                // set the data.
+                m_newArrays[k]->SetTuple(i,&cValue);
+            }
+        }
+    }
+
+private:
+    vtkCellLocator*                                     m_locator;
+    vtkPolyData*                                        m_surface;
+    const std::vector<vtkDataArray*>&                   m_volumeArrays;
+    const std::vector<vtkSmartPointer<vtkDataArray> >&  m_newArrays;
+    std::vector<vtkSmartPointer<vtkGenericCell> >       m_cells;
+    std::vector<double>                                 m_weights;
+};
+
+/** Interpolates one array at a batch of located points. A prism of -1
+  * gives the blank value. **/
+template <class T>
+void InterpolatePrisms(const T* data, T* output, vtkIdType count, const vtkIdType* prisms,
+                       const vtkIdType* pointIds, const double* weights)
+{
+    for (vtkIdType j = 0; j < count; ++j)
+    {
+        if (prisms[j] == -1)
+        {
+            output[j] = static_cast<T>(-1000000.);
+            continue;
+        }
+        const vtkIdType* ids = pointIds + 6*j;
+        const double* w = weights + 6*j;
+        output[j] = static_cast<T>(data[ids[0]]*w[0] + data[ids[1]]*w[1] + data[ids[2]]*w[2] +
+                                   data[ids[3]]*w[3] + data[ids[4]]*w[4] + data[ids[5]]*w[5]);
+    }
+}
+
+/** Probes the points of a surface in a volume of wedges swept along one
+  * vector, or projects them onto a surface, using a PrismLocator. The
+  * points are taken a batch at a time, first locating each point and
+  * working out its weights, then running each array through the batch.
+  * For a wedge swept along a constant vector the weights are the triangle
+  * barycentrics times (1-t) for the bottom points and t for the top
+  * points. On a surface they are the barycentrics alone. Float and double
+  * arrays are read and written through their raw pointers. **/
+class PrismProber : public ParallelRangeFunctor
+{
+public:
+    PrismProber(const PrismLocator& locator, vtkPolyData* surface, const std::vector<vtkDataArray*>& volumeArrays,
+                const std::vector<vtkSmartPointer<vtkDataArray> >& newArrays)
+        : m_locator(locator), m_surface(surface), m_volumeArrays(volumeArrays), m_newArrays(newArrays)
+    {
+    }
+
+    void Execute(vtkIdType begin, vtkIdType end, int)
+    {
+        const vtkIdType batchSize = 256;
+        bool wedges = m_locator.GetIdsPerPrism() == 6;
+        vtkIdType prisms[batchSize];
+        vtkIdType pointIds[6*batchSize];
+        double weights[6*batchSize];
+        double cPoint[3];
+        double barycentrics[3];
+        double t;
+        for (vtkIdType batch = begin; batch < end; batch += batchSize)
+        {
+            vtkIdType count = (end - batch < batchSize) ? end - batch : batchSize;
+
+            // locate the batch
+            for (vtkIdType j = 0; j < count; ++j)
+            {
+                m_surface->GetPoint(batch + j,cPoint);
+                prisms[j] = m_locator.FindPrism(cPoint,barycentrics,t);
+                if (prisms[j] == -1)
+                {
+                    continue;
+                }
+                const vtkIdType* ids = m_locator.GetPrismPointIds(prisms[j]);
+                double* w = weights + 6*j;
+                if (wedges)
+                {
+                    std::memcpy(pointIds + 6*j,ids,6*sizeof(vtkIdType));
+                    for (int p = 0; p < 3; ++p)
+                    {
+                        w[p] = barycentrics[p]*(1 - t);
+                        w[p+3] = barycentrics[p]*t;
+                    }
+                }
+                else
+                {
+                    // a triangle fills the second three with weights of zero
+                    std::memcpy(pointIds + 6*j,ids,3*sizeof(vtkIdType));
+                    std::memcpy(pointIds + 6*j + 3,ids,3*sizeof(vtkIdType));
+                    for (int p = 0; p < 3; ++p)
+                    {
+                        w[p] = barycentrics[p];
+                        w[p+3] = 0;
+                    }
+                }
+            }
+
+            // interpolate every array over the batch
+            for (size_t k = 0; k < m_newArrays.size(); ++k)
+            {
+                vtkDataArray* data = m_volumeArrays[k];
+                vtkDataArray* output = m_newArrays[k];
+                if (data->GetNumberOfComponents() == 1 && data->GetDataType() == VTK_DOUBLE)
+                {
+                    InterpolatePrisms(static_cast<double*>(data->GetVoidPointer(0)),
+                                      static_cast<double*>(output->GetVoidPointer(batch)),
+                                      count,prisms,pointIds,weights);
+                }
+                else if (data->GetNumberOfComponents() == 1 && data->GetDataType() == VTK_FLOAT)
+                {
+                    InterpolatePrisms(static_cast<float*>(data->GetVoidPointer(0)),
+                                      static_cast<float*>(output->GetVoidPointer(batch)),
+                                      count,prisms,pointIds,weights);
+                }
+                else
+                {
+                    for (vtkIdType j = 0; j < count; ++j)
+                    {
+                        double cValue = -1000000.;
+                        if (prisms[j] != -1)
+                        {
+                            cValue = 0;
+                            for (int p = 0; p < 6; ++p)
+                            {
+                                cValue += data->GetComponent(pointIds[6*j+p],0)*weights[6*j+p];
+                            }
+                        }
+                        output->SetTuple(batch + j,&cValue);
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    const PrismLocator&                                 m_locator;
+    vtkPolyData*                                        m_surface;
+    const std::vector<vtkDataArray*>&                   m_volumeArrays;
+    const std::vector<vtkSmartPointer<vtkDataArray> >&  m_newArrays;
+};
+
+/** A surface sharing the points and cells of surface, without its point
+  * data, with an array for each array of sourceData, of the same type, to
+  * take the probed values. The first is called "Extracted Data" and the
+  * rest keep their names. **/
+vtkSmartPointer<vtkPolyData> NewProbedSurface(vtkPolyData* surface, vtkPointData* sourceData,
+                                              std::vector<vtkDataArray*>& sourceArrays,
+                                              std::vector<vtkSmartPointer<vtkDataArray> >& newArrays)
+{
+    vtkSmartPointer<vtkPolyData> outputSurface = vtkSmartPointer<vtkPolyData>::New();
+    outputSurface->CopyStructure(surface);
+
+    int numberOfArrays = sourceData->GetNumberOfArrays();
+    sourceArrays.resize(numberOfArrays);
+    newArrays.resize(numberOfArrays);
+    for (int k = 0; k < numberOfArrays; ++k)
+    {
+        sourceArrays[k] = sourceData->GetArray(k);
+        newArrays[k].TakeReference(sourceArrays[k]->NewInstance());
+        newArrays[k]->SetNumberOfComponents(1);
+        newArrays[k]->SetNumberOfTuples(outputSurface->GetNumberOfPoints());
+        newArrays[k]->SetName(k == 0 ? "Extracted Data" : sourceArrays[k]->GetName());
+        outputSurface->GetPointData()->AddArray(newArrays[k]);
+    }
+    return outputSurface;
+}
+
+/** Moves points by the first three rows of a 4x4 matrix. **/
+template <class T>
+class PointTransformer : public ParallelRangeFunctor
+{
+public:
+    void Execute(vtkIdType begin, vtkIdType end, int)
+    {
+        for (vtkIdType i = begin; i < end; ++i)
+        {
+            const T* x = inputPoints + 3*i;
+            T* y = outputPoints + 3*i;
+            double x0 = x[0];
+            double x1 = x[1];
+            double x2 = x[2];
+            for (int r = 0; r < 3; ++r)
+            {
+                y[r] = static_cast<T>(matrix[r][0]*x0 + matrix[r][1]*x1 + matrix[r][2]*x2 + matrix[r][3]);
+            }
+        }
+    }
+
+    double      matrix[3][4];
+    const T*    inputPoints;
+    T*          outputPoints;
+};
+
+/** Write the n input points moved by matrix into outputPoints. **/
+template <class T>
+void TransformPoints(const T* inputPoints, T* outputPoints, vtkIdType n, vtkMatrix4x4* matrix, int numberOfThreads)
+{
+    PointTransformer<T> transformer;
+    for (int r = 0; r < 3; ++r)
+    {
+        for (int c = 0; c < 4; ++c)
+        {
+            transformer.matrix[r][c] = matrix->GetElement(r,c);
+        }
+    }
+    transformer.inputPoints = inputPoints;
+    transformer.outputPoints = outputPoints;
+    ParallelRange::Execute(n,&transformer,0,numberOfThreads);
+}
+
+/** A copy of points moved by the rigid or affine matrix. Float points stay
+  * float and anything else becomes double. **/
+vtkSmartPointer<vtkPoints> NewTransformedPoints(vtkPoints* points, vtkMatrix4x4* matrix, int numberOfThreads)
+{
+    vtkIdType numberOfPoints = points->GetNumberOfPoints();
+    vtkDataArray* pointData = points->GetData();
+    vtkSmartPointer<vtkPoints> newPoints = vtkSmartPointer<vtkPoints>::New();
+    newPoints->SetDataType(pointData->GetDataType() == VTK_FLOAT ? VTK_FLOAT : VTK_DOUBLE);
+    newPoints->SetNumberOfPoints(numberOfPoints);
+    if (numberOfPoints > 0 && newPoints->GetDataType() == VTK_FLOAT)
+    {
+        TransformPoints(static_cast<float*>(pointData->GetVoidPointer(0)),static_cast<float*>(newPoints->GetVoidPointer(0)),
+                        numberOfPoints,matrix,numberOfThreads);
+    }
+    else if (numberOfPoints > 0)
+    {
+        vtkSmartPointer<vtkDoubleArray> doubleData = vtkDoubleArray::SafeDownCast(pointData);
+        if (!doubleData)
+        {
+            doubleData = vtkSmartPointer<vtkDoubleArray>::New();
+            doubleData->DeepCopy(pointData);
+        }
+        TransformPoints(doubleData->GetPointer(0),static_cast<double*>(newPoints->GetVoidPointer(0)),
+                        numberOfPoints,matrix,numberOfThreads);
+    }
+    return newPoints;
+}
+
+/** A surface with the points of surface moved by matrix. The cells and the
+  * point and cell data arrays are shared with surface, not copied. **/
+vtkSmartPointer<vtkPolyData> NewTransformedSurface(vtkPolyData* surface, vtkMatrix4x4* matrix, int numberOfThreads)
+{
+    vtkSmartPointer<vtkPolyData> outputSurface = vtkSmartPointer<vtkPolyData>::New();
+    outputSurface->CopyStructure(surface);
+    outputSurface->SetPoints(NewTransformedPoints(surface->GetPoints(),matrix,numberOfThreads));
+    outputSurface->GetPointData()->ShallowCopy(surface->GetPointData());
+    outputSurface->GetCellData()->ShallowCopy(surface->GetCellData());
+    return outputSurface;
+}
+
+/** The delta of a reciever and donor value, as stored in an array of T.
+  * A reciever value of -1000000, given by ProbeVolume where there was no
+  * overlap, is carried through. **/
+template <class T>
+inline T Delta(double recieverValue, double donorValue)
+{
+    return static_cast<T>((recieverValue == -1000000) ? -1000000 : donorValue - recieverValue);
+}
+
+/** Mark the points whose delta is above the -999990 threshold. **/
+template <class T>
+void MarkValidPoints(const T* reciever, int recieverComponents, const T* donor, int donorComponents,
+                     vtkIdType numberOfPoints, unsigned char* valid)
+{
+    for (vtkIdType i = 0; i < numberOfPoints; ++i)
+    {
+        valid[i] = (Delta<T>(reciever[i*recieverComponents],donor[i*donorComponents]) >= -999990);
+    }
+}
+
+/** Fill delta with the delta of the first components of the points in ids. **/
+template <class T>
+void ComputeDelta(const T* reciever, int recieverComponents, const T* donor, int donorComponents,
+                  const vtkIdType* ids, vtkIdType numberOfPoints, T* delta)
+{
+    for (vtkIdType i = 0; i < numberOfPoints; ++i)
+    {
+        delta[i] = Delta<T>(reciever[ids[i]*recieverComponents],donor[ids[i]*donorComponents]);
+    }
+}
+
+/** Copy the tuples of input at ids, in order, to output. **/
+template <class TIn, class TOut>
+void GatherValues(const TIn* input, int numberOfComponents, const vtkIdType* ids, vtkIdType numberOfTuples, TOut* output)
+{
+    for (vtkIdType i = 0; i < numberOfTuples; ++i)
+    {
+        const TIn* tuple = input + ids[i]*numberOfComponents;
+        for (int c = 0; c < numberOfComponents; ++c)
+        {
+            output[c] = static_cast<TOut>(tuple[c]);
+        }
+        output += numberOfComponents;
+    }
+}
+
+/** Find which points of the compiled surface are kept, from the first
+  * pair of arrays. Float and double pairs are read directly, anything
+  * else through vtkDataArray. **/
+void FindValidPoints(vtkDataArray* reciever, vtkDataArray* donor, std::vector<unsigned char>& valid)
+{
+    vtkIdType numberOfPoints = valid.size();
+    int type = donor->GetDataType();
+    if (numberOfPoints > 0 && type == VTK_DOUBLE && reciever->GetDataType() == VTK_DOUBLE)
+    {
+        MarkValidPoints(static_cast<double*>(reciever->GetVoidPointer(0)),reciever->GetNumberOfComponents(),
+                        static_cast<double*>(donor->GetVoidPointer(0)),donor->GetNumberOfComponents(),numberOfPoints,&valid[0]);
+    }
+    else if (numberOfPoints > 0 && type == VTK_FLOAT && reciever->GetDataType() == VTK_FLOAT)
+    {
+        MarkValidPoints(static_cast<float*>(reciever->GetVoidPointer(0)),reciever->GetNumberOfComponents(),
+                        static_cast<float*>(donor->GetVoidPointer(0)),donor->GetNumberOfComponents(),numberOfPoints,&valid[0]);
+    }
+    else
+    {
+        // the delta is stored with the type of the donor, so test it as stored
+        vtkSmartPointer<vtkDataArray> stored;
+        stored.TakeReference(donor->NewInstance());
+        stored->SetNumberOfTuples(1);
+        for (vtkIdType i = 0; i < numberOfPoints; ++i)
+        {
+            stored->SetComponent(0,0,Delta<double>(reciever->GetComponent(i,0),donor->GetComponent(i,0)));
+            valid[i] = (stored->GetComponent(0,0) >= -999990);
+        }
+    }
+}
+
+/** Fill delta with the delta of the first pair of components of the
+  * points in ids. **/
+void FillDelta(vtkDataArray* reciever, vtkDataArray* donor, const std::vector<vtkIdType>& ids, vtkDataArray* delta)
+{
+    vtkIdType numberOfPoints = ids.size();
+    int type = donor->GetDataType();
+    if (numberOfPoints > 0 && type == VTK_DOUBLE && reciever->GetDataType() == VTK_DOUBLE)
+    {
+        ComputeDelta(static_cast<double*>(reciever->GetVoidPointer(0)),reciever->GetNumberOfComponents(),
+                     static_cast<double*>(donor->GetVoidPointer(0)),donor->GetNumberOfComponents(),
+                     &ids[0],numberOfPoints,static_cast<double*>(delta->GetVoidPointer(0)));
+    }
+    else if (numberOfPoints > 0 && type == VTK_FLOAT && reciever->GetDataType() == VTK_FLOAT)
+    {
+        ComputeDelta(static_cast<float*>(reciever->GetVoidPointer(0)),reciever->GetNumberOfComponents(),
+                     static_cast<float*>(donor->GetVoidPointer(0)),donor->GetNumberOfComponents(),
+                     &ids[0],numberOfPoints,static_cast<float*>(delta->GetVoidPointer(0)));
+    }
+    else
+    {
+        for (vtkIdType i = 0; i < numberOfPoints; ++i)
+        {
+            delta->SetComponent(i,0,Delta<double>(reciever->GetComponent(ids[i],0),donor->GetComponent(ids[i],0)));
+        }
+    }
+}
+
+/** Copy the tuples of input at ids, in order, to output, which must
+  * already hold as many tuples as there are ids. **/
+void GatherTuples(vtkDataArray* input, const std::vector<vtkIdType>& ids, vtkDataArray* output)
+{
+    vtkIdType numberOfTuples = ids.size();
+    int numberOfComponents = input->GetNumberOfComponents();
+    int inputType = input->GetDataType();
+    int outputType = output->GetDataType();
+    if (numberOfTuples == 0)
+    {
+        return;
+    }
+    if (inputType == VTK_DOUBLE && outputType == VTK_DOUBLE)
+    {
+        GatherValues(static_cast<double*>(input->GetVoidPointer(0)),numberOfComponents,&ids[0],numberOfTuples,
+                     static_cast<double*>(output->GetVoidPointer(0)));
+    }
+    else if (inputType == VTK_FLOAT && outputType == VTK_FLOAT)
+    {
+        GatherValues(static_cast<float*>(input->GetVoidPointer(0)),numberOfComponents,&ids[0],numberOfTuples,
+                     static_cast<float*>(output->GetVoidPointer(0)));
+    }
+    else if (inputType == VTK_DOUBLE && outputType == VTK_FLOAT)
+    {
+        GatherValues(static_cast<double*>(input->GetVoidPointer(0)),numberOfComponents,&ids[0],numberOfTuples,
+                     static_cast<float*>(output->GetVoidPointer(0)));
+    }
+    else if (inputType == outputType && inputType != VTK_BIT)
+    {
+        size_t tupleBytes = static_cast<size_t>(numberOfComponents)*input->GetDataTypeSize();
+        const char* inputData = static_cast<const char*>(input->GetVoidPointer(0));
+        char* outputData = static_cast<char*>(output->GetVoidPointer(0));
+        for (vtkIdType i = 0; i < numberOfTuples; ++i)
+        {
+            memcpy(outputData + i*tupleBytes,inputData + ids[i]*tupleBytes,tupleBytes);
+        }
+    }
+    else
+    {
+        for (vtkIdType i = 0; i < numberOfTuples; ++i)
+        {
+            output->SetTuple(i,input->GetTuple(ids[i]));
+        }
+    }
+}
+
+/** One column of the output files: a component of an array, read
+  * directly when it is float or double. **/
+struct OutputColumn
+{
+    OutputColumn(vtkDataArray* columnArray, int columnComponent)
+    {
+        array = columnArray;
+        component = columnComponent;
+        type = array->GetDataType();
+        data = array->GetVoidPointer(0);
+        numberOfComponents = array->GetNumberOfComponents();
+    }
+
+    double GetValue(vtkIdType i) const
+    {
+        if (type == VTK_DOUBLE)
+        {
+            return static_cast<const double*>(data)[i*numberOfComponents + component];
+        }
+        if (type == VTK_FLOAT)
+        {
+            return static_cast<const float*>(data)[i*numberOfComponents + component];
+        }
+        return array->GetComponent(i,component);
+    }
+
+    vtkDataArray*   array;
+    int             component;
+    int             type;
+    const void*     data;
+    int             numberOfComponents;
+};
+
+/** Formats the rows of the text file into blocks, each block on its own
+  * thread. The values are formatted as "%g", as operator<< gave. **/
+class TextRowFormatter : public ParallelRangeFunctor
+{
+public:
+    void Execute(vtkIdType begin, vtkIdType end, int)
+    {
+        char value[32];
+        for (vtkIdType block = begin; block < end; ++block)
+        {
+            std::string& text = blocks[block];
+            text.clear();
+            vtkIdType firstRow = firstBlockRow + block*rowsPerBlock;
+            vtkIdType lastRow = std::min(firstRow + rowsPerBlock,numberOfRows);
+            for (vtkIdType row = firstRow; row < lastRow; ++row)
+            {
+                text.append(value,snprintf(value,sizeof(value),"%ld",static_cast<long>(row)));
+                for (size_t c = 0; c < columns.size(); ++c)
+                {
+                    text.push_back(',');
+                    text.append(value,snprintf(value,sizeof(value),"%g",columns[c].GetValue(row)));
+                }
+                text.push_back('\n');
+            }
+        }
+    }
+
+    std::vector<OutputColumn>   columns;
+    std::vector<std::string>    blocks;
+    vtkIdType                   rowsPerBlock;
+    vtkIdType                   firstBlockRow;
+    vtkIdType                   numberOfRows;
+};
+
+/** The start of the columnar binary file. **/
+struct ColumnFileHeader
+{
+    char            magic[8];           // "SCOLUMNS"
+    boost::uint32_t version;
+    boost::uint32_t byteOrder;          // 0x01020304 in the byte order of the file
+    boost::uint64_t numberOfRows;
+    boost::uint32_t numberOfColumns;
+    boost::uint32_t reserved;
+};
+
+/** The description of one column of the columnar binary file, following
+  * the header. **/
+struct ColumnFileColumn
+{
+    char            name[64];           // null terminated
+    boost::uint32_t type;               // 1 for 64 bit integers, 2 for doubles
+    boost::uint32_t elementSize;
+    boost::uint64_t offset;             // from the start of the file
+};
+
+// the columns start on multiples of this many bytes
+const boost::uint64_t columnAlignment = 64;
+
+inline boost::uint64_t AlignColumn(boost::uint64_t offset)
+{
+    return (offset + columnAlignment - 1)/columnAlignment*columnAlignment;
+}
+} // namespace
+
 CompareSurfaces::CompareSurfaces()
 {
     // create a new readers
@@ -39,6 +661,15 @@ CompareSurfaces::CompareSurfaces()
     // set the default data names
     m_recieverName = "reciever";
     m_donorName = "donor";
+    m_numberOfThreads = 0;
+    m_useRigidICP = false;
+    m_donorCache = false;
+    m_donorHash = 0;
+    m_extrusionVector[0] = 0;
+    m_extrusionVector[1] = 0;
+    m_extrusionVector[2] = 0;
+    m_stageTimer = 0;
+    m_log = &std::cout;
 }
 
 CompareSurfaces::~CompareSurfaces()
@@ -48,60 +679,106 @@ CompareSurfaces::~CompareSurfaces()
 
 void CompareSurfaces::ExtrudeSurface(vtkSmartPointer<vtkPolyData> surf,double vect[3])
 {
+    ScopedStage stage(m_stageTimer,"extrude");
     // make the vector 5 mm long
     double length = sqrt(pow(vect[0],2)+pow(vect[1],2)+pow(vect[2],2));
     double scale = 5/length;
     vect[0] = vect[0]*scale;
     vect[1] = vect[1]*scale;
     vect[2] = vect[2]*scale;
-    // transform the surface to be extruded in the -vect
-    vtkSmartPointer<vtkTransform> transformer = vtkSmartPointer<vtkTransform>::New();
-    transformer->Translate(-vect[0],-vect[1],-vect[2]);
-    vtkSmartPointer<vtkTransformPolyDataFilter> polyMover = vtkSmartPointer<vtkTransformPolyDataFilter>::New();
-    polyMover->SetTransform(transformer);
-    polyMover->SetInput(surf);
-
-    // use the append filter to convert the PolyData to UnstructuredGrid
-    vtkSmartPointer<vtkAppendFilter> appender = vtkSmartPointer<vtkAppendFilter>::New();
-    appender->SetInputConnection(polyMover->GetOutputPort());
-    appender->Update();
-    vtkSmartPointer<vtkUnstructuredGrid> tempGrid = appender->GetOutput();
-
-    // iterate through the points
-    unsigned int originalNumberOfPoints = tempGrid->GetNumberOfPoints();
-    for (unsigned int i = 0; i < originalNumberOfPoints;++i)
-    {
-        double cPoint[3];
-        tempGrid->GetPoint(i,cPoint);
-        // for each point, create a child point in the point data at a location 2*vect away
-        tempGrid->GetPoints()->InsertNextPoint(cPoint[0]+2*vect[0],cPoint[1]+2*vect[1],cPoint[2]+2*vect[2]);
-        // get the data for the parent point and copy it into the child point
-        tempGrid->GetPointData()->GetArray(0)->InsertNextTuple(tempGrid->GetPointData()->GetArray(0)->GetTuple(i));
-    }
-
-    // iterate through the cells (trangles) of the original data
-    unsigned int originalNumberOfCells = tempGrid->GetNumberOfCells();
-    for (unsigned int i= 0; i < originalNumberOfCells;++i)
-    {
-        // for each cell, get a list of the defining points
-        vtkSmartPointer<vtkIdList> cPoints = vtkSmartPointer<vtkIdList>::New();
-        tempGrid->GetCellPoints(i,cPoints);
-        // create a list of points for the new, wedge cell. The points are the original list
-        // plus the child poit of each one of those. They are sepearted by the originial number of points
-        vtkSmartPointer<vtkIdList> newPoints = vtkSmartPointer<vtkIdList>::New();
-        newPoints->InsertNextId(cPoints->GetId(0));
-        newPoints->InsertNextId(cPoints->GetId(1));
-        newPoints->InsertNextId(cPoints->GetId(2));
-        newPoints->InsertNextId(cPoints->GetId(0)+originalNumberOfPoints);
-        newPoints->InsertNextId(cPoints->GetId(1)+originalNumberOfPoints);
-        newPoints->InsertNextId(cPoints->GetId(2)+originalNumberOfPoints);
-        // insert a new wedge cell, defined by the points
-        tempGrid->InsertNextCell(13,newPoints);
 
+    // the volume holds each surface point moved back by vect, then the child of each
+    // point at a location 2*vect away. Everything is sized once and filled in place.
+    vtkSmartPointer<vtkUnstructuredGrid> tempGrid = vtkSmartPointer<vtkUnstructuredGrid>::New();
+    vtkIdType originalNumberOfPoints = surf->GetNumberOfPoints();
+    vtkDataArray* surfaceData = surf->GetPoints()->GetData();
+    vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+    points->SetDataType(surfaceData->GetDataType() == VTK_FLOAT ? VTK_FLOAT : VTK_DOUBLE);
+    points->SetNumberOfPoints(2*originalNumberOfPoints);
+    if (originalNumberOfPoints > 0 && points->GetDataType() == VTK_FLOAT)
+    {
+        ExtrudePoints(static_cast<float*>(surfaceData->GetVoidPointer(0)),static_cast<float*>(points->GetVoidPointer(0)),
+                      originalNumberOfPoints,vect,m_numberOfThreads);
+    }
+    else if (originalNumberOfPoints > 0)
+    {
+        vtkSmartPointer<vtkDoubleArray> doubleData = vtkDoubleArray::SafeDownCast(surfaceData);
+        if (!doubleData)
+        {
+            doubleData = vtkSmartPointer<vtkDoubleArray>::New();
+            doubleData->DeepCopy(surfaceData);
+        }
+        ExtrudePoints(doubleData->GetPointer(0),static_cast<double*>(points->GetVoidPointer(0)),
+                      originalNumberOfPoints,vect,m_numberOfThreads);
+    }
+    tempGrid->SetPoints(points);
+
+    // the data of the parent point is copied into the child point, for every array
+    for (int k = 0; k < surf->GetPointData()->GetNumberOfArrays(); ++k)
+    {
+        vtkDataArray* surfaceArray = surf->GetPointData()->GetArray(k);
+        if (!surfaceArray)
+        {
+            continue;
+        }
+        vtkSmartPointer<vtkDataArray> newArray;
+        newArray.TakeReference(surfaceArray->NewInstance());
+        newArray->SetNumberOfComponents(surfaceArray->GetNumberOfComponents());
+        newArray->SetNumberOfTuples(2*originalNumberOfPoints);
+        newArray->SetName(surfaceArray->GetName());
+        size_t arrayBytes = static_cast<size_t>(originalNumberOfPoints)*surfaceArray->GetNumberOfComponents()*surfaceArray->GetDataTypeSize();
+        if (arrayBytes > 0)
+        {
+            char* newData = static_cast<char*>(newArray->GetVoidPointer(0));
+            memcpy(newData,surfaceArray->GetVoidPointer(0),arrayBytes);
+            memcpy(newData + arrayBytes,surfaceArray->GetVoidPointer(0),arrayBytes);
+        }
+        tempGrid->GetPointData()->AddArray(newArray);
     }
 
+    // find the triangles of the surface, each becomes a wedge
+    vtkCellArray* polys = surf->GetPolys();
+    const vtkIdType* polyData = polys->GetPointer();
+    vtkIdType numberOfEntries = polys->GetNumberOfConnectivityEntries();
+    std::vector<vtkIdType> triangleLocations;
+    triangleLocations.reserve(polys->GetNumberOfCells());
+    for (vtkIdType location = 0; location < numberOfEntries; location += polyData[location] + 1)
+    {
+        if (polyData[location] == 3)
+        {
+            triangleLocations.push_back(location);
+        }
+    }
+    vtkIdType numberOfWedges = triangleLocations.size();
+
+    // the wedges are stored as 6,p0,p1,p2,p0+n,p1+n,p2+n
+    vtkSmartPointer<vtkIdTypeArray> cells = vtkSmartPointer<vtkIdTypeArray>::New();
+    cells->SetNumberOfValues(7*numberOfWedges);
+    vtkSmartPointer<vtkIdTypeArray> locations = vtkSmartPointer<vtkIdTypeArray>::New();
+    locations->SetNumberOfValues(numberOfWedges);
+    vtkSmartPointer<vtkUnsignedCharArray> types = vtkSmartPointer<vtkUnsignedCharArray>::New();
+    types->SetNumberOfValues(numberOfWedges);
+    if (numberOfWedges > 0)
+    {
+        memset(types->GetPointer(0),VTK_WEDGE,numberOfWedges);
+        ExtrusionBuilder<float> builder;
+        builder.stage = ExtrusionBuilder<float>::Wedges;
+        builder.numberOfPoints = originalNumberOfPoints;
+        builder.polys = polyData;
+        builder.triangleLocations = &triangleLocations[0];
+        builder.cells = cells->GetPointer(0);
+        builder.locations = locations->GetPointer(0);
+        ParallelRange::Execute(numberOfWedges,&builder,0,m_numberOfThreads);
+    }
+    vtkSmartPointer<vtkCellArray> wedges = vtkSmartPointer<vtkCellArray>::New();
+    wedges->SetCells(numberOfWedges,cells);
+    tempGrid->SetCells(types,locations,wedges);
+
     // put the data into the classes extruded volume.
     m_extrudedVolume = tempGrid;
+    // remember what the volume was made from, to find its donor cache
+    m_extrudedSurface = surf;
+    std::copy(vect,vect + 3,m_extrusionVector);
 }
 
 void CompareSurfaces::GetSurfaceCentroid(vtkSmartPointer<vtkPolyData> surface,double centroid[3])
@@ -124,90 +801,166 @@ void CompareSurfaces::GetSurfaceCentroid(vtkSmartPointer<vtkPolyData> surface,do
 
 vtkSmartPointer<vtkPolyData> CompareSurfaces::ProbeVolume(vtkSmartPointer<vtkUnstructuredGrid> volume, vtkSmartPointer<vtkPolyData> surface)
 {
-    vtkSmartPointer<vtkPolyData> outputSurface = vtkSmartPointer<vtkPolyData>::New();
-    outputSurface->DeepCopy(surface);
-    unsigned int numberOfArrays = outputSurface->GetPointData()->GetNumberOfArrays();
-    for (unsigned int i = 0; i < numberOfArrays; ++i)
+    // create a new array to hold the data of each volume array, of the same type as the
+    // volume data
+    std::vector<vtkDataArray*> volumeArrays;
+    std::vector<vtkSmartPointer<vtkDataArray> > newArrays;
+    vtkSmartPointer<vtkPolyData> outputSurface = NewProbedSurface(surface,volume->GetPointData(),volumeArrays,newArrays);
+
+    int numberOfThreads = ParallelRange::GetNumberOfThreads(m_numberOfThreads);
+
+    // a volume from ExtrudeSurface is one triangle swept along one vector, so
+    // the cells are found in the plane across the sweep
+    PrismLocator prismLocator;
+    vtkPolyData* extrudedSurface = (volume == m_extrudedVolume) ? m_extrudedSurface.GetPointer() : 0;
+    if (BuildDonorLocator(prismLocator,extrudedSurface,volume,m_extrusionVector))
     {
-        outputSurface->GetPointData()->RemoveArray(i);
+        PrismProber prober(prismLocator,outputSurface,volumeArrays,newArrays);
+        ScopedStage probeStage(m_stageTimer,"probe");
+        ParallelRange::Execute(outputSurface->GetNumberOfPoints(),&prober,0,numberOfThreads);
+        return outputSurface;
     }
 
-    // create a new array to hold the data
-    vtkSmartPointer<vtkDoubleArray> newArray = vtkSmartPointer<vtkDoubleArray>::New();
-    newArray->SetNumberOfComponents(1);
-    newArray->SetNumberOfTuples(outputSurface->GetNumberOfPoints());
-    newArray->SetName("Extracted Data");
-    outputSurface->GetPointData()->AddArray(newArray);
-
     // create a cell locator to aid in finding the cells that points belong to
     vtkSmartPointer<vtkCellLocator> cellLocator =
     vtkSmartPointer<vtkCellLocator>::New();
     cellLocator->SetDataSet(volume);
+    ScopedStage locatorStage(m_stageTimer,"locator build");
     cellLocator->BuildLocator();
+    locatorStage.Stop();
 
-    // these will be used in the loop to hold data
-    vtkSmartPointer<vtkWedge> cCell;
-    double blankTuple = -1000000.;
-    double cPoint[3];
-    double closestPoint[3];
-    int subId;
-    double pcoords[3];
-    double dist2;
-    double weights[6];
-    double cellData[6];
-    double cValue;
-    vtkIdType cCellNo;
-    vtkSmartPointer<vtkIdList> cellPoints;
-
-    // loop through each point in the input surface
-    for (unsigned int i = 0; i < outputSurface->GetNumberOfPoints(); i++)
-    {
-        // get the point location
-        outputSurface->GetPoint(i,cPoint);
-        // find the cell that contains the point
-        cCellNo = cellLocator->FindCell(cPoint);
-        if (cCellNo == -1)  // if the point is outside of cells, enter a value of zero in the data array
-        {
-            newArray->SetTuple(i,&blankTuple);
-            continue;
-        }
-        if (volume->GetCellType(cCellNo) != 13) // if the cell isn't a wedge, skip it.
+    // probe the points in parallel, each thread with its own cell and weights
+    VolumeProber prober(cellLocator,outputSurface,volumeArrays,newArrays,numberOfThreads);
+    ScopedStage probeStage(m_stageTimer,"probe");
+    ParallelRange::Execute(outputSurface->GetNumberOfPoints(),&prober,0,numberOfThreads);
+    return outputSurface;
+}
+
+vtkSmartPointer<vtkPolyData> CompareSurfaces::ProjectSurface(vtkSmartPointer<vtkPolyData> donorSurf, vtkSmartPointer<vtkPolyData> surface, double direction[3])
+{
+    std::vector<vtkDataArray*> donorArrays;
+    std::vector<vtkSmartPointer<vtkDataArray> > newArrays;
+    vtkSmartPointer<vtkPolyData> outputSurface = NewProbedSurface(surface,donorSurf->GetPointData(),donorArrays,newArrays);
+
+    // reach 5 mm either side of the donor, as the volume from ExtrudeSurface does
+    double length = sqrt(pow(direction[0],2)+pow(direction[1],2)+pow(direction[2],2));
+    double scale = 5/length;
+    double vect[3] = {direction[0]*scale,direction[1]*scale,direction[2]*scale};
+    PrismLocator prismLocator;
+    BuildDonorLocator(prismLocator,donorSurf,0,vect);
+
+    int numberOfThreads = ParallelRange::GetNumberOfThreads(m_numberOfThreads);
+    PrismProber prober(prismLocator,outputSurface,donorArrays,newArrays);
+    ScopedStage probeStage(m_stageTimer,"probe");
+    ParallelRange::Execute(outputSurface->GetNumberOfPoints(),&prober,0,numberOfThreads);
+    return outputSurface;
+}
+
+bool CompareSurfaces::GetDonorCacheFile(vtkPolyData* donorSurf, std::string suffix, const double* parameters,
+                                        int numberOfParameters, std::string& fileName, boost::uint64_t& key)
+{
+    std::string donorFileName;
+    if (!m_donorCache || !donorSurf)
+    {
+        return false;
+    }
+    else if (donorSurf == m_donorReader->GetOutput() && m_donorReader->GetFileName())
+    {
+        donorFileName = m_donorReader->GetFileName();
+    }
+    else if (donorSurf == m_donorCacheSurface && !m_donorCacheFileName.empty())
+    {
+        donorFileName = m_donorCacheFileName;
+    }
+    else
+    {
+        return false;
+    }
+    if (donorFileName != m_donorHashFileName)
+    {
+        m_donorHash = BinaryCache::GetInitialHash();
+        if (!BinaryCache::HashFile(donorFileName,m_donorHash))
         {
-            continue;
+            m_donorHashFileName.clear();
+            return false;
         }
-        // get the point IDs that define the containing cell
-        cellPoints = volume->GetCell(cCellNo)->GetPointIds();
-        // get the strain values for each point in the containing cell
-        cellData[0] = *volume->GetPointData()->GetArray(0)->GetTuple(cellPoints->GetId(0));
-        cellData[1] = *volume->GetPointData()->GetArray(0)->GetTuple(cellPoints->GetId(1));
-        cellData[2] = *volume->GetPointData()->GetArray(0)->GetTuple(cellPoints->GetId(2));
-        cellData[3] = *volume->GetPointData()->GetArray(0)->GetTuple(cellPoints->GetId(3));
-        cellData[4] = *volume->GetPointData()->GetArray(0)->GetTuple(cellPoints->GetId(4));
-        cellData[5] = *volume->GetPointData()->GetArray(0)->GetTuple(cellPoints->GetId(5));
-
-        // use the EvaluatePosition method of the cell to get the interpolation function weight values. The rest of the data is not used
-        volume->GetCell(cCellNo)->EvaluatePosition(cPoint,closestPoint,subId,pcoords,dist2,weights);
-        // calculate the value at the point by multiplying each weight by the data
-        cValue = cellData[0]*weights[0] + cellData[1]*weights[1] + cellData[2]*weights[2] + cellData[3]*weights[3] + cellData[4]*weights[4] + cellData[5]*weights[5];
-        // set the data.
-        newArray->SetTuple(i,&cValue);
+        m_donorHashFileName = donorFileName;
+    }
+    fileName = donorFileName + suffix;
+    key = BinaryCache::HashBytes(suffix.data(),suffix.size(),m_donorHash);
+    key = BinaryCache::HashBytes(parameters,numberOfParameters*sizeof(double),key);
+    return true;
+}
 
+bool CompareSurfaces::BuildDonorLocator(PrismLocator& locator, vtkPolyData* donorSurf, vtkUnstructuredGrid* volume,
+                                        const double direction[3])
+{
+    ScopedStage stage(m_stageTimer,"locator build");
+    std::string cacheFileName;
+    boost::uint64_t cacheKey;
+    bool cached = GetDonorCacheFile(donorSurf,volume ? ".extrusion.cache" : ".projection.cache",direction,3,
+                                    cacheFileName,cacheKey);
+    BinaryCacheReader cacheReader;
+    if (cached && cacheReader.Open(cacheFileName,cacheKey) && locator.Read(cacheReader) && cacheReader.AtEnd() &&
+        (!volume || locator.GetNumberOfPrisms() == volume->GetNumberOfCells()))
+    {
+        return true;
+    }
+
+    bool built = true;
+    if (volume)
+    {
+        built = locator.BuildFromWedges(volume);
+    }
+    else
+    {
+        locator.BuildFromSurface(donorSurf,direction);
+    }
+    if (built && cached)
+    {
+        BinaryCacheWriter cacheWriter(cacheFileName,cacheKey);
+        locator.Write(cacheWriter);
+        cacheWriter.Commit();
+    }
+    return built;
+}
+
+void CompareSurfaces::SetRigidICPTarget(vtkPolyData* donorSurf)
+{
+    std::string cacheFileName;
+    boost::uint64_t cacheKey;
+    bool cached = GetDonorCacheFile(donorSurf,".icp.cache",0,0,cacheFileName,cacheKey);
+    BinaryCacheReader cacheReader;
+    if (cached && cacheReader.Open(cacheFileName,cacheKey) && m_rigidICP.ReadTarget(donorSurf,cacheReader) &&
+        cacheReader.AtEnd())
+    {
+        return;
+    }
+
+    m_rigidICP.SetTarget(donorSurf);
+    if (cached)
+    {
+        BinaryCacheWriter cacheWriter(cacheFileName,cacheKey);
+        m_rigidICP.WriteTarget(cacheWriter);
+        cacheWriter.Commit();
     }
-    return outputSurface;
 }
 
 vtkSmartPointer<vtkPolyData> CompareSurfaces::AlignSurfaces(vtkSmartPointer<vtkPolyData> recieverSurf, vtkSmartPointer<vtkPolyData> donorSurf)
 {
+    ScopedStage stage(m_stageTimer,"align");
     // create the icp transform
     vtkSmartPointer<vtkIterativeClosestPointTransform> icp = vtkSmartPointer<vtkIterativeClosestPointTransform>::New();
-    // use the output of icp as the final transform.
-    vtkSmartPointer<vtkTransformPolyDataFilter> finalTransform = vtkSmartPointer<vtkTransformPolyDataFilter>::New();
+    // the surface the icp starts from, which holds only points when it is moved
+    vtkSmartPointer<vtkPolyData> icpSource;
+    // the initial transform, identity if none was given
+    vtkSmartPointer<vtkMatrix4x4> initialMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
 
     // if an initial transfor was given, use it
     if (m_translate[0]!=0 || m_translate[1]!=0 || m_translate[2]!=0
         || m_rotate[0]!=0 || m_rotate[1]!=0 || m_rotate[2]!=0)
         {
-            std::cout<<"Setting the initial transform"<<std::endl;
+            *m_log<<"Setting the initial transform"<<std::endl;
         // create a general transform for the initial transform
         vtkSmartPointer<vtkTransform> initialTranRot = vtkSmartPointer<vtkTransform>::New();
         initialTranRot->Translate(m_translate);
@@ -215,27 +968,20 @@ vtkSmartPointer<vtkPolyData> CompareSurfaces::AlignSurfaces(vtkSmartPointer<vtkP
         initialTranRot->RotateY(m_rotate[1]);
         initialTranRot->RotateZ(m_rotate[2]);
 
-        // transform recieverSurf using the rough transform
-        vtkSmartPointer<vtkTransformPolyDataFilter> initialTransform = vtkSmartPointer<vtkTransformPolyDataFilter>::New();
-        initialTransform->SetInput(recieverSurf);
-        initialTransform->SetTransform(initialTranRot);
-        initialTransform->Update();
-
-        // set the output of the initial tranform to be the input of the ICP
-        icp->SetSource(initialTransform->GetOutput());
-
-        // set the output of the initial transform to be the input to the final transform
-        finalTransform->SetInput(initialTransform->GetOutput());
+        // move the reciever points by the rough transform to be the input of the ICP
+        initialMatrix->DeepCopy(initialTranRot->GetMatrix());
+        icpSource = vtkSmartPointer<vtkPolyData>::New();
+        icpSource->SetPoints(NewTransformedPoints(recieverSurf->GetPoints(),initialMatrix,m_numberOfThreads));
+        m_rigidICP.SetStartByMatchingCentroids(false);
         }
     else
         {
-            std::cout<<"Matching centroids"<<std::endl;
+            *m_log<<"Matching centroids"<<std::endl;
         // if no initial transform was set start by matching centroids
         icp->StartByMatchingCentroidsOn();
+        m_rigidICP.SetStartByMatchingCentroids(true);
         // make the reciever surface the source
-        icp->SetSource(recieverSurf);
-        // set the final transform input to be the reciever surface
-        finalTransform->SetInput(recieverSurf);
+        icpSource = recieverSurf;
         }
 
 //    vtkSmartPointer<vtkXMLPolyDataWriter> tempWriter = vtkSmartPointer<vtkXMLPolyDataWriter>::New();
@@ -244,79 +990,171 @@ vtkSmartPointer<vtkPolyData> CompareSurfaces::AlignSurfaces(vtkSmartPointer<vtkP
 //    tempWriter->Write();
 
     // use the output of the of the rough transform as the input to the fine icp calculation
-    icp->SetTarget(donorSurf);
-    icp->GetLandmarkTransform()->SetModeToRigidBody();
-    icp->Modified();
-    icp->Update();
-
-    // perform the final transform
-    finalTransform->SetTransform(icp);
-    finalTransform->Update();
+    vtkSmartPointer<vtkMatrix4x4> fineMatrix;
+    if (m_useRigidICP)
+    {
+        m_rigidICP.SetSource(icpSource->GetPoints());
+        SetRigidICPTarget(donorSurf);
+        m_rigidICP.SetNumberOfThreads(m_numberOfThreads);
+        m_rigidICP.Update();
+        fineMatrix = m_rigidICP.GetMatrix();
+    }
+    else
+    {
+        icp->SetSource(icpSource);
+        icp->SetTarget(donorSurf);
+        icp->GetLandmarkTransform()->SetModeToRigidBody();
+        icp->Modified();
+        icp->Update();
+        fineMatrix = icp->GetMatrix();
+    }
 
-    // return the output from the final transfrom
-    return finalTransform->GetOutput();
+    // compose the initial and icp transforms and move the reciever points once. The
+    // aligned surface shares its cells and data arrays with recieverSurf.
+    vtkSmartPointer<vtkMatrix4x4> alignment = vtkSmartPointer<vtkMatrix4x4>::New();
+    vtkMatrix4x4::Multiply4x4(fineMatrix,initialMatrix,alignment);
+    return NewTransformedSurface(recieverSurf,alignment,m_numberOfThreads);
 }
 
 void CompareSurfaces::CompileData( vtkSmartPointer<vtkPolyData> recieverSurf, vtkSmartPointer<vtkPolyData> donorSurf)
 {
-    // copy the structure of the reciever surface as this is the of the compiled surface
-    vtkSmartPointer<vtkPolyData> tempSurface = vtkSmartPointer<vtkPolyData>::New();
-    tempSurface->CopyStructure(recieverSurf);
-
-    // create a new data array for the drop tower strain
-    vtkSmartPointer<vtkDoubleArray> recieverData = vtkSmartPointer<vtkDoubleArray>::New();
-    recieverData->DeepCopy(recieverSurf->GetPointData()->GetArray(0));
-    recieverData->SetName(m_recieverName.c_str());
-
-    // create a new data array for the instron strain
-    vtkSmartPointer<vtkDoubleArray> donorData = vtkSmartPointer<vtkDoubleArray>::New();
-    donorData->DeepCopy(donorSurf->GetPointData()->GetArray(0));
-    donorData->SetName(m_donorName.c_str());
-
-    // create a new data array for the difference between them
-    vtkSmartPointer<vtkDoubleArray> diff = vtkSmartPointer<vtkDoubleArray>::New();
-    diff->SetNumberOfTuples(tempSurface->GetNumberOfPoints());
-    diff->SetNumberOfComponents(1);
-    diff->SetName("delta");
-
-    // iterate through the points in the compliled surface and fill in the data arrays.
-    for (unsigned int i = 0; i<tempSurface->GetNumberOfPoints();++i)
-    {
-        double* cDonor = donorData->GetTuple(i);
-        double* cReciever = recieverData->GetTuple(i);
-        double cDiff;
-        // in the ProbvVolume method, -1000000 was used to indicate a point with no data. Carry that though.
-        if (*cReciever == -1000000)
+    ScopedStage stage(m_stageTimer,"compile");
+    // the compiled surface is built in one pass over the reciever surface, in place of
+    // copying the arrays into a temporary surface and thresholding that. The output is
+    // the same as vtkThreshold gave: float points numbered in the order the kept cells
+    // first use them, and the arrays in reciever, donor, delta triples.
+    m_compiledSurf = vtkSmartPointer<vtkUnstructuredGrid>::New();
+
+    // pair the reciever and donor arrays. The first pair is named with the names set for
+    // the data and the rest with those names followed by the name of the reciever array.
+    int numberOfArrays = recieverSurf->GetPointData()->GetNumberOfArrays();
+    if (donorSurf->GetPointData()->GetNumberOfArrays() < numberOfArrays)
+    {
+        numberOfArrays = donorSurf->GetPointData()->GetNumberOfArrays();
+    }
+    if (numberOfArrays == 0)
+    {
+        // without a "delta" array there is nothing to threshold on, so nothing is kept
+        return;
+    }
+
+    // in the ProbeVolume method, -1000000 was used to indicate a point with no data. The
+    // points whose first delta is below -999990 are removed with every cell using them.
+    vtkIdType numberOfPoints = recieverSurf->GetNumberOfPoints();
+    std::vector<unsigned char> validPoints(numberOfPoints);
+    FindValidPoints(recieverSurf->GetPointData()->GetArray(0),donorSurf->GetPointData()->GetArray(0),validPoints);
+
+    // keep the cells with every point valid and number their points as they are first used
+    std::vector<vtkIdType> newIds(numberOfPoints,-1);
+    std::vector<vtkIdType> oldIds;      // the reciever point of each compiled point
+    vtkSmartPointer<vtkIdTypeArray> cells = vtkSmartPointer<vtkIdTypeArray>::New();
+    vtkSmartPointer<vtkIdTypeArray> locations = vtkSmartPointer<vtkIdTypeArray>::New();
+    vtkSmartPointer<vtkUnsignedCharArray> types = vtkSmartPointer<vtkUnsignedCharArray>::New();
+    vtkIdType numberOfCells = 0;
+    for (vtkIdType cellId = 0; cellId < recieverSurf->GetNumberOfCells(); ++cellId)
+    {
+        vtkIdType numberOfCellPoints;
+        vtkIdType* cellPoints;
+        recieverSurf->GetCellPoints(cellId,numberOfCellPoints,cellPoints);
+        bool keep = (numberOfCellPoints > 0);
+        for (vtkIdType i = 0; keep && i < numberOfCellPoints; ++i)
+        {
+            keep = validPoints[cellPoints[i]];
+        }
+        if (!keep)
         {
-            cDiff = -1000000;
+            continue;
         }
-        else
+        locations->InsertNextValue(cells->GetNumberOfTuples());
+        types->InsertNextValue(static_cast<unsigned char>(recieverSurf->GetCellType(cellId)));
+        cells->InsertNextValue(numberOfCellPoints);
+        for (vtkIdType i = 0; i < numberOfCellPoints; ++i)
         {
-            cDiff = *cDonor-*cReciever;
+            vtkIdType& newId = newIds[cellPoints[i]];
+            if (newId < 0)
+            {
+                newId = oldIds.size();
+                oldIds.push_back(cellPoints[i]);
+            }
+            cells->InsertNextValue(newId);
         }
-        diff->SetTuple(i,&cDiff);
+        ++numberOfCells;
     }
+    std::vector<vtkIdType>().swap(newIds);
+    vtkIdType numberOfCompiledPoints = oldIds.size();
 
-    // add the arrays to the point data
-    tempSurface->GetPointData()->AddArray(recieverData);
-    tempSurface->GetPointData()->AddArray(donorData);
-    tempSurface->GetPointData()->AddArray(diff);
+    // the points are float. When every point is kept in its own place, float points are shared.
+    bool allPointsInPlace = (numberOfCompiledPoints == numberOfPoints);
+    for (vtkIdType i = 0; allPointsInPlace && i < numberOfCompiledPoints; ++i)
+    {
+        allPointsInPlace = (oldIds[i] == i);
+    }
+    if (allPointsInPlace && recieverSurf->GetPoints()->GetDataType() == VTK_FLOAT)
+    {
+        m_compiledSurf->SetPoints(recieverSurf->GetPoints());
+    }
+    else
+    {
+        vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+        points->SetDataTypeToFloat();
+        points->SetNumberOfPoints(numberOfCompiledPoints);
+        GatherTuples(recieverSurf->GetPoints()->GetData(),oldIds,points->GetData());
+        m_compiledSurf->SetPoints(points);
+    }
+    vtkSmartPointer<vtkCellArray> cellArray = vtkSmartPointer<vtkCellArray>::New();
+    cellArray->SetCells(numberOfCells,cells);
+    m_compiledSurf->SetCells(types,locations,cellArray);
 
-    // threshold the temporary surface to remove data where there was no overlap
-    vtkSmartPointer<vtkThreshold> threshold = vtkSmartPointer<vtkThreshold>::New();
-    threshold->SetInput(tempSurface);
-    threshold->SetInputArrayToProcess(0,0,0,
-                                      vtkDataObject::FIELD_ASSOCIATION_POINTS,
-                                      "delta");
-    threshold->ThresholdByUpper(-999990);
-    threshold->Update();
+    // fill in the arrays at the compiled points
+    for (int k = 0; k < numberOfArrays; ++k)
+    {
+        vtkDataArray* recieverArray = recieverSurf->GetPointData()->GetArray(k);
+        vtkDataArray* donorArray = donorSurf->GetPointData()->GetArray(k);
+        std::string recieverName = m_recieverName;
+        std::string donorName = m_donorName;
+        std::string diffName = "delta";
+        if (k > 0)
+        {
+            std::string arrayName = recieverArray->GetName();
+            recieverName += " " + arrayName;
+            donorName += " " + arrayName;
+            diffName += " " + arrayName;
+        }
+
+        // create a new data array for the drop tower strain
+        vtkSmartPointer<vtkDataArray> recieverData;
+        recieverData.TakeReference(recieverArray->NewInstance());
+        recieverData->SetNumberOfComponents(recieverArray->GetNumberOfComponents());
+        recieverData->SetNumberOfTuples(numberOfCompiledPoints);
+        recieverData->SetName(recieverName.c_str());
+        GatherTuples(recieverArray,oldIds,recieverData);
 
-    // return the compiled surface
-    m_compiledSurf = threshold->GetOutput();
+        // create a new data array for the instron strain
+        vtkSmartPointer<vtkDataArray> donorData;
+        donorData.TakeReference(donorArray->NewInstance());
+        donorData->SetNumberOfComponents(donorArray->GetNumberOfComponents());
+        donorData->SetNumberOfTuples(numberOfCompiledPoints);
+        donorData->SetName(donorName.c_str());
+        GatherTuples(donorArray,oldIds,donorData);
+
+        // create a new data array for the difference between them
+        vtkSmartPointer<vtkDataArray> diff;
+        diff.TakeReference(donorArray->NewInstance());
+        diff->SetNumberOfComponents(1);
+        diff->SetNumberOfTuples(numberOfCompiledPoints);
+        diff->SetName(diffName.c_str());
+        FillDelta(recieverArray,donorArray,oldIds,diff);
+
+        // add the arrays to the point data
+        m_compiledSurf->GetPointData()->AddArray(recieverData);
+        m_compiledSurf->GetPointData()->AddArray(donorData);
+        m_compiledSurf->GetPointData()->AddArray(diff);
+    }
 }
 
 void CompareSurfaces::WriteDataToFile(std::string fileName)
 {
+    ScopedStage stage(m_stageTimer,"write");
     // open the file for writing
     std::ofstream outFile;
     outFile.open(fileName.c_str(), std::ios::trunc);
@@ -326,29 +1164,153 @@ void CompareSurfaces::WriteDataToFile(std::string fileName)
         return;
     }
     // write the header line
-    outFile << "Reviever (Moving) File Name: "<<m_recieverReader->GetFileName()<<std::endl;
-    outFile << "Donor (Fixed) File Name:" <<m_donorReader->GetFileName()<<std::endl;
+    outFile << "Reviever (Moving) File Name: "<<m_recieverReader->GetFileName()<<"\n";
+    outFile << "Donor (Fixed) File Name:" <<m_donorReader->GetFileName()<<"\n";
     outFile << "Initial Transform. Translate ("<<m_translate[0]<<","<<m_translate[1]<<","<<m_translate[2]<<"). Rotate ("<<
-        m_rotate[0]<<","<<m_rotate[1]<<","<<m_rotate[2]<<")"<<std::endl;
+        m_rotate[0]<<","<<m_rotate[1]<<","<<m_rotate[2]<<")\n";
+    // the arrays come in reciever, donor, delta triples. Triples after the first are
+    // written after the location.
+    int numberOfTriples = m_compiledSurf->GetPointData()->GetNumberOfArrays()/3;
     outFile << "Point,"<<m_compiledSurf->GetPointData()->GetArray(0)->GetName()<<","<<
-        m_compiledSurf->GetPointData()->GetArray(1)->GetName()<<",Diff,x,y,z"<<std::endl;
-
-    // write the rest of the file
-    double aStrain;
-    double bStrain;
-    double diff;
-    double loc[3];
-    for (int i = 0; i < m_compiledSurf->GetNumberOfPoints(); ++i)
+        m_compiledSurf->GetPointData()->GetArray(1)->GetName()<<",Diff,x,y,z";
+    for (int k = 3; k < 3*numberOfTriples; ++k)
     {
-        m_compiledSurf->GetPointData()->GetArray(0)->GetTuple(i,&aStrain);
-        m_compiledSurf->GetPointData()->GetArray(1)->GetTuple(i,&bStrain);
-        m_compiledSurf->GetPointData()->GetArray(2)->GetTuple(i,&diff);
-        m_compiledSurf->GetPoint(i,loc);
+        outFile << ","<<m_compiledSurf->GetPointData()->GetArray(k)->GetName();
+    }
+    outFile << "\n";
 
-        outFile << i <<","<<aStrain<<","<<bStrain<<","<<diff<<","<<loc[0]<<","<<loc[1]<<","<<loc[2]<<std::endl;
+    // write the rest of the file. The rows are formatted a wave of blocks at a time, in
+    // parallel, and each wave is written in order before the next is formatted.
+    TextRowFormatter formatter;
+    for (int k = 0; k < 3; ++k)
+    {
+        formatter.columns.push_back(OutputColumn(m_compiledSurf->GetPointData()->GetArray(k),0));
+    }
+    for (int c = 0; c < 3; ++c)
+    {
+        formatter.columns.push_back(OutputColumn(m_compiledSurf->GetPoints()->GetData(),c));
+    }
+    for (int k = 3; k < 3*numberOfTriples; ++k)
+    {
+        formatter.columns.push_back(OutputColumn(m_compiledSurf->GetPointData()->GetArray(k),0));
+    }
+    formatter.rowsPerBlock = 16384;
+    formatter.numberOfRows = m_compiledSurf->GetNumberOfPoints();
+    vtkIdType blocksPerWave = 4*ParallelRange::GetNumberOfThreads(m_numberOfThreads);
+    formatter.blocks.resize(blocksPerWave);
+    for (formatter.firstBlockRow = 0; formatter.firstBlockRow < formatter.numberOfRows;
+         formatter.firstBlockRow += blocksPerWave*formatter.rowsPerBlock)
+    {
+        vtkIdType numberOfBlocks = (formatter.numberOfRows - formatter.firstBlockRow + formatter.rowsPerBlock - 1)/formatter.rowsPerBlock;
+        numberOfBlocks = std::min(numberOfBlocks,blocksPerWave);
+        ParallelRange::Execute(numberOfBlocks,&formatter,1,m_numberOfThreads);
+        for (vtkIdType block = 0; block < numberOfBlocks; ++block)
+        {
+            outFile.write(formatter.blocks[block].data(),formatter.blocks[block].size());
+        }
     }
 
     outFile.close();
 
 
 }
+
+void CompareSurfaces::WriteDataToBinaryFile(std::string fileName)
+{
+    ScopedStage stage(m_stageTimer,"write");
+    std::ofstream outFile;
+    outFile.open(fileName.c_str(), std::ios::trunc | std::ios::binary);
+    if (!outFile.is_open()) // if it failes to open, exit
+    {
+        std::cerr<<"Error opening output file: "<<fileName<<"\nPlease check the name and try again."<<std::endl;
+        return;
+    }
+
+    // the columns are those of the text file: the point, the first triple, the location
+    // and any further triples, named as in its header
+    vtkPointData* pointData = m_compiledSurf->GetPointData();
+    int numberOfTriples = pointData->GetNumberOfArrays()/3;
+    std::vector<std::string> names(1,"Point");
+    std::vector<OutputColumn> columns;
+    for (int k = 0; k < 3; ++k)
+    {
+        names.push_back((k == 2) ? "Diff" : pointData->GetArray(k)->GetName());
+        columns.push_back(OutputColumn(pointData->GetArray(k),0));
+    }
+    const char* locationNames[3] = {"x","y","z"};
+    for (int c = 0; c < 3; ++c)
+    {
+        names.push_back(locationNames[c]);
+        columns.push_back(OutputColumn(m_compiledSurf->GetPoints()->GetData(),c));
+    }
+    for (int k = 3; k < 3*numberOfTriples; ++k)
+    {
+        names.push_back(pointData->GetArray(k)->GetName());
+        columns.push_back(OutputColumn(pointData->GetArray(k),0));
+    }
+
+    // write the header and the description of each column
+    vtkIdType numberOfRows = m_compiledSurf->GetNumberOfPoints();
+    ColumnFileHeader header;
+    memset(&header,0,sizeof(header));
+    memcpy(header.magic,"SCOLUMNS",sizeof(header.magic));
+    header.version = 1;
+    header.byteOrder = 0x01020304;
+    header.numberOfRows = numberOfRows;
+    header.numberOfColumns = names.size();
+    outFile.write(reinterpret_cast<const char*>(&header),sizeof(header));
+    boost::uint64_t offset = AlignColumn(sizeof(header) + names.size()*sizeof(ColumnFileColumn));
+    for (size_t c = 0; c < names.size(); ++c)
+    {
+        ColumnFileColumn column;
+        memset(&column,0,sizeof(column));
+        names[c].copy(column.name,sizeof(column.name) - 1);
+        column.type = (c == 0) ? 1 : 2;
+        column.elementSize = 8;
+        column.offset = offset;
+        outFile.write(reinterpret_cast<const char*>(&column),sizeof(column));
+        offset = AlignColumn(offset + 8*static_cast<boost::uint64_t>(numberOfRows));
+    }
+
+    // write each column in one piece. A double array of one component is written
+    // straight from the array, anything else is gathered into a buffer first.
+    std::vector<char> padding(columnAlignment,0);
+    std::vector<double> buffer;
+    for (size_t c = 0; c < names.size(); ++c)
+    {
+        boost::uint64_t position = outFile.tellp();
+        outFile.write(&padding[0],AlignColumn(position) - position);
+        if (numberOfRows == 0)
+        {
+            continue;
+        }
+        if (c == 0)
+        {
+            std::vector<boost::int64_t> points(numberOfRows);
+            for (vtkIdType i = 0; i < numberOfRows; ++i)
+            {
+                points[i] = i;
+            }
+            outFile.write(reinterpret_cast<const char*>(&points[0]),numberOfRows*sizeof(boost::int64_t));
+            continue;
+        }
+        const OutputColumn& column = columns[c-1];
+        if (column.type == VTK_DOUBLE && column.numberOfComponents == 1)
+        {
+            outFile.write(static_cast<const char*>(column.data),numberOfRows*sizeof(double));
+            continue;
+        }
+        buffer.resize(numberOfRows);
+        for (vtkIdType i = 0; i < numberOfRows; ++i)
+        {
+            buffer[i] = column.GetValue(i);
+        }
+        outFile.write(reinterpret_cast<const char*>(&buffer[0]),numberOfRows*sizeof(double));
+    }
+
+    outFile.close();
+    if (outFile.fail())
+    {
+        std::cerr<<"Error writing output file: "<<fileName<<std::endl;
+    }
+}
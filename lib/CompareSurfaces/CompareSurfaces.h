@@ -34,13 +34,24 @@
 #include <vtkIdList.h>
 #include <vtkCellLocator.h>
 #include <vtkWedge.h>
+#include <vtkGenericCell.h>
 #include <vtkCell.h>
 #include <vtkDoubleArray.h>
 #include <vtkAppendFilter.h>
 #include <vtkXMLPolyDataReader.h>
-#include <vtkThreshold.h>
 #include <vtkPointData.h>
 #include <vtkCellArray.h>
+#include <vtkIdTypeArray.h>
+#include <vtkUnsignedCharArray.h>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include "../BinaryCache/BinaryCache.h"
+#include "../ParallelRange/ParallelRange.h"
+#include "../PrismLocator/PrismLocator.h"
+#include "../RigidICP/RigidICP.h"
+#include "../StageTimer/StageTimer.h"
 
 class CompareSurfaces
 {
@@ -61,10 +72,16 @@ class CompareSurfaces
 
         /** A function to extrude the a surface. It extrudes the surface
           * in the direaction defined by a vector from the centroid of
-          * one of the input reader's surfaces to the other.**/
+          * one of the input reader's surfaces to the other. Each triangle
+          * of the surface becomes a wedge and the volume holds only the
+          * wedges. The points and wedges are filled in parallel.**/
         void ExtrudeSurface(vtkSmartPointer<vtkPolyData> surface,double direction[3]);
 
-        /** A function to get the volume created by ExtrudeSurface. **/
+        /** A function to get the volume created by ExtrudeSurface. It
+          * holds each surface point moved 5 mm back along the direction,
+          * then each moved 5 mm forward, both with the data of the surface
+          * point. Its cells are only the wedges, one for each triangle of
+          * the surface in order, and none of the surface triangles. **/
         vtkSmartPointer<vtkUnstructuredGrid> GetExtrudedVolume()
             {
                 return m_extrudedVolume;
@@ -76,13 +93,31 @@ class CompareSurfaces
         void GetSurfaceCentroid( vtkSmartPointer<vtkPolyData> surface, double centroid[3]);
 
         /** A function to probe an extruded volume. Returns the surface
-          * with data information from the volume projected onto it. **/
+          * with data information from the volume projected onto it. Every
+          * array of the volume is interpolated, the first is called
+          * "Extracted Data" and the rest keep their names. The points are
+          * probed in parallel. Points outside the wedges of the volume get
+          * the value -1000000. A volume made by ExtrudeSurface is probed
+          * with a PrismLocator, any other with a vtkCellLocator. **/
         vtkSmartPointer<vtkPolyData> ProbeVolume(vtkSmartPointer<vtkUnstructuredGrid> volume,
                                                  vtkSmartPointer<vtkPolyData> surface);
 
+        /** A function to transfer the data of donorSurf onto surface
+          * without building a volume. Each point of surface is projected
+          * along direction onto the donor triangles and the donor data is
+          * interpolated there. Points further than 5 from the donor along
+          * direction, the reach of the volume made by ExtrudeSurface, or
+          * not over a triangle get the value -1000000. The arrays are
+          * named as by ProbeVolume. **/
+        vtkSmartPointer<vtkPolyData> ProjectSurface(vtkSmartPointer<vtkPolyData> donorSurf,
+                                                    vtkSmartPointer<vtkPolyData> surface,
+                                                    double direction[3]);
+
         /** A function to align the surfaces, with the points set using
           * SetInitialPoints as the initial transform. Returs recieverSurf
-          * transformed to be aligned with donorSurf. **/
+          * transformed to be aligned with donorSurf. The returned surface
+          * has new points but shares its cells and data arrays with
+          * recieverSurf. **/
         vtkSmartPointer<vtkPolyData> AlignSurfaces(vtkSmartPointer<vtkPolyData> recieverSurf,
                                                    vtkSmartPointer<vtkPolyData> donorSurf);
 
@@ -181,12 +216,18 @@ class CompareSurfaces
          * those set in SetRecieverDataName() and SetDonorDataName(). The
          * defalut names are "reciever" and "donor". A thrid dataset is
          * created called "delta" which is the difference between the two and
-         * is calculated as (donor - reciever).
+         * is calculated as (donor - reciever). If the surfaces have more
+         * than one array, the arrays are paired in order and each further
+         * triple is named with the names above followed by the name of the
+         * reciever array.
          *
          * Finally, the data is thresholded. The ProbeVolume() method
          * uses a value of -1000000 in locations where there was no overlap
          * between the volume ans surface. This step removes cells that
-         * have values in the "delta" field of <-999999. **/
+         * have values in the "delta" field of <-999999. The kept points
+         * and cells are gathered straight into the compiled surface in one
+         * pass, with the same result as vtkThreshold. Float points are shared
+         * with reciever when every point is kept in its place. **/
         void CompileData( vtkSmartPointer<vtkPolyData> recieverSurf, vtkSmartPointer<vtkPolyData> donorSurf);
 
         /** A function to return the surface with the compiled data in it.
@@ -217,16 +258,136 @@ class CompareSurfaces
             }
         }
 
+        /** Set/Get whether AlignSurfaces registers the surfaces with the
+          * RigidICP engine instead of vtkIterativeClosestPointTransform.
+          * Its settings are changed through GetRigidICP(). The default is
+          * off. **/
+        void SetUseRigidICP(bool use)
+        {
+            if (m_useRigidICP != use)
+            {
+                m_useRigidICP = use;
+            }
+        }
+        bool GetUseRigidICP()
+        {
+            return m_useRigidICP;
+        }
+
+        /** A function to get the RigidICP engine, to change its settings
+          * or read the iterations and distance of the last alignment. **/
+        RigidICP* GetRigidICP()
+        {
+            return &m_rigidICP;
+        }
+
+        /** Set/Get whether what is built from the donor surface is kept
+          * in cache files next to the file of GetDonorReader(), so later
+          * runs against the same donor read it instead of building it.
+          * The RigidICP target goes in donorFile.icp.cache, the locator of
+          * the volume from ExtrudeSurface in donorFile.extrusion.cache and
+          * that of ProjectSurface in donorFile.projection.cache. Each is
+          * keyed by a hash of the content of the donor file and the
+          * direction used, and is rebuilt when the key does not match.
+          * Only the surface read by the donor reader, or one given to
+          * SetDonorCacheSource, is cached. The
+          * default is off. **/
+        void SetDonorCache(bool cache)
+        {
+            if (m_donorCache != cache)
+            {
+                m_donorCache = cache;
+            }
+        }
+        bool GetDonorCache()
+        {
+            return m_donorCache;
+        }
+
+        /** Set a donor surface that was not read by GetDonorReader(), and
+          * the file it was read from, so the donor cache can be used for
+          * it, such as a copy of a donor shared between comparisons. **/
+        void SetDonorCacheSource(vtkSmartPointer<vtkPolyData> donorSurf, std::string fileName)
+        {
+            m_donorCacheSurface = donorSurf;
+            m_donorCacheFileName = fileName;
+        }
+
+        /** Set/Get the timer the stages are added to: "align",
+          * "extrude", "locator build", "probe", "compile" and "write".
+          * The locators built by ProbeVolume and ProjectSurface are timed
+          * apart from the probing. The timer is not owned. The default
+          * of null times nothing. **/
+        void SetStageTimer(StageTimer* timer)
+        {
+            if (m_stageTimer != timer)
+            {
+                m_stageTimer = timer;
+            }
+        }
+        StageTimer* GetStageTimer()
+        {
+            return m_stageTimer;
+        }
+
+        /** Set/Get the number of threads used by ExtrudeSurface,
+          * ProbeVolume and the RigidICP engine. The default of 0 uses
+          * every processor. **/
+        void SetNumberOfThreads(int numberOfThreads)
+        {
+            if (m_numberOfThreads != numberOfThreads)
+            {
+                m_numberOfThreads = numberOfThreads;
+            }
+        }
+        int GetNumberOfThreads()
+        {
+            return m_numberOfThreads;
+        }
+
         /** A function to write the strain difference to a file given as
           * an input. The header will contain the format of the file.
           * where the strains are in whatever units were specified in
-          * the input files. **/
+          * the input files. The columns of any further arrays follow
+          * the location. The rows are formatted in blocks on
+          * GetNumberOfThreads() threads and written in order, in large
+          * writes rather than a flush per line. **/
         void WriteDataToFile(std::string fileName);
 
+        /** Write the columns of WriteDataToFile to a binary file given as
+          * an input, at full precision and laid out to be memory mapped.
+          * The file starts with a 32 byte header: the magic "SCOLUMNS", a
+          * 32 bit version of 1, the 32 bit value 0x01020304 in the byte
+          * order of the file, the 64 bit number of rows, the 32 bit number
+          * of columns and 4 reserved bytes. An 80 byte description of each
+          * column follows: its null terminated name in 64 bytes, its 32
+          * bit type (1 for 64 bit integers, 2 for doubles), its 32 bit
+          * element size and the 64 bit offset of its values from the
+          * start of the file. Each column is the contiguous values of
+          * every row, starting on a multiple of 64 bytes. The point column
+          * holds integers and the rest doubles. **/
+        void WriteDataToBinaryFile(std::string fileName);
+
 
     protected:
     private:
 
+    /** The name and key of the donor cache file ending in suffix for
+      * donorSurf, used with the given parameters. Returns false if the
+      * donor cache is off or donorSurf was not read by the donor reader
+      * or given to SetDonorCacheSource.
+      * The donor file is hashed once for each file name. **/
+    bool GetDonorCacheFile(vtkPolyData* donorSurf, std::string suffix, const double* parameters,
+                           int numberOfParameters, std::string& fileName, boost::uint64_t& key);
+    /** Build locator from the wedges of volume, the extrusion of
+      * donorSurf along direction, or if volume is null from donorSurf
+      * swept along direction. The locator is read from the donor cache
+      * when it is there. Returns false if volume is not a sweep. **/
+    bool BuildDonorLocator(PrismLocator& locator, vtkPolyData* donorSurf, vtkUnstructuredGrid* volume,
+                           const double direction[3]);
+    /** Set donorSurf as the RigidICP target, through the donor cache. **/
+    void SetRigidICPTarget(vtkPolyData* donorSurf);
+
     /** Private types **/
     vtkSmartPointer<vtkXMLPolyDataReader>   m_recieverReader;
     vtkSmartPointer<vtkXMLPolyDataReader>   m_donorReader;
@@ -240,6 +401,17 @@ class CompareSurfaces
     vtkSmartPointer<vtkUnstructuredGrid> m_extrudedVolume;
     std::string     m_recieverName;
     std::string     m_donorName;
+    int             m_numberOfThreads;
+    bool            m_useRigidICP;
+    RigidICP        m_rigidICP;
+    bool            m_donorCache;
+    vtkSmartPointer<vtkPolyData> m_donorCacheSurface;   // a donor from SetDonorCacheSource
+    std::string     m_donorCacheFileName;               // the file m_donorCacheSurface was read from
+    std::string     m_donorHashFileName;    // the donor file m_donorHash is of
+    boost::uint64_t m_donorHash;
+    vtkSmartPointer<vtkPolyData> m_extrudedSurface; // what m_extrudedVolume was made from
+    StageTimer*     m_stageTimer;
+    double          m_extrusionVector[3];
 
 };
 
@@ -0,0 +1,107 @@
+/*
+ * ParallelRange.cpp
+ *
+ * Copyright 2013 Seth Gilchrist <seth@fake.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#include "ParallelRange.h"
+
+namespace
+{
+// the state shared by the threads of one Execute call
+struct RangeState
+{
+    ParallelRangeFunctor*       functor;
+    vtkIdType                   numberOfItems;
+    vtkIdType                   grain;
+    vtkIdType                   nextItem;
+    vtkSimpleCriticalSection    lock;
+};
+
+VTK_THREAD_RETURN_TYPE ExecuteRange(void* arg)
+{
+    vtkMultiThreader::ThreadInfo* info = static_cast<vtkMultiThreader::ThreadInfo*>(arg);
+    RangeState* state = static_cast<RangeState*>(info->UserData);
+    while (true)
+    {
+        // take the next block of items
+        state->lock.Lock();
+        vtkIdType begin = state->nextItem;
+        state->nextItem += state->grain;
+        state->lock.Unlock();
+        if (begin >= state->numberOfItems)
+        {
+            break;
+        }
+        vtkIdType end = begin + state->grain;
+        end = (end > state->numberOfItems) ? state->numberOfItems : end;
+        state->functor->Execute(begin,end,info->ThreadID);
+    }
+    return VTK_THREAD_RETURN_VALUE;
+}
+}
+
+void ParallelRange::Execute(vtkIdType numberOfItems, ParallelRangeFunctor* functor, vtkIdType grain, int numberOfThreads)
+{
+    if (numberOfItems <= 0)
+    {
+        return;
+    }
+    numberOfThreads = GetNumberOfThreads(numberOfThreads);
+    if (grain <= 0)
+    {
+        // a few blocks per thread so a slow block doesn't hold up the rest
+        grain = numberOfItems/(4*numberOfThreads);
+        grain = (grain < 1) ? 1 : grain;
+    }
+    vtkIdType numberOfBlocks = (numberOfItems + grain - 1)/grain;
+    numberOfThreads = (numberOfBlocks < numberOfThreads) ? static_cast<int>(numberOfBlocks) : numberOfThreads;
+
+    // don't pay for thread start up when there is only one thread
+    if (numberOfThreads == 1)
+    {
+        functor->Execute(0,numberOfItems,0);
+        return;
+    }
+
+    RangeState state;
+    state.functor = functor;
+    state.numberOfItems = numberOfItems;
+    state.grain = grain;
+    state.nextItem = 0;
+
+    vtkMultiThreader* threader = vtkMultiThreader::New();
+    threader->SetNumberOfThreads(numberOfThreads);
+    threader->SetSingleMethod(ExecuteRange,&state);
+    threader->SingleMethodExecute();
+    threader->Delete();
+}
+
+int ParallelRange::GetNumberOfThreads()
+{
+    return vtkMultiThreader::GetGlobalDefaultNumberOfThreads();
+}
+
+int ParallelRange::GetNumberOfThreads(int numberOfThreads)
+{
+    numberOfThreads = (numberOfThreads > 0) ? numberOfThreads : GetNumberOfThreads();
+    numberOfThreads = (numberOfThreads > VTK_MAX_THREADS) ? VTK_MAX_THREADS : numberOfThreads;
+    return (numberOfThreads < 1) ? 1 : numberOfThreads;
+}
@@ -0,0 +1,64 @@
+/*
+ * ParallelRange.h
+ *
+ * Copyright 2013 Seth Gilchrist <seth@fake.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#ifndef PARALLELRANGE_H
+#define PARALLELRANGE_H
+
+#include <vtkType.h>
+#include <vtkMultiThreader.h>
+#include <vtkCriticalSection.h>
+
+/** The work done by ParallelRange::Execute. Subclasses hold whatever
+  * they need as members and process one block of items per call. **/
+class ParallelRangeFunctor
+{
+    public:
+        virtual ~ParallelRangeFunctor() {}
+
+        /** Process the items begin to end-1. threadId is between 0 and
+          * the number of threads - 1 and can be used to index per thread
+          * scratch space. Calls may come from several threads at once. **/
+        virtual void Execute(vtkIdType begin, vtkIdType end, int threadId) = 0;
+};
+
+class ParallelRange
+{
+    public:
+        /** Run functor over the items 0 to numberOfItems-1. The items are
+          * split into blocks of grain items that the threads take in turn,
+          * so uneven work is balanced. A grain of 0 picks a block size from
+          * the number of items and threads. A numberOfThreads of 0 uses
+          * GetNumberOfThreads(). Returns when all items are processed. **/
+        static void Execute(vtkIdType numberOfItems, ParallelRangeFunctor* functor,
+                            vtkIdType grain = 0, int numberOfThreads = 0);
+
+        /** The number of threads used when none is given to Execute. This
+          * is the number of processors reported by vtkMultiThreader. **/
+        static int GetNumberOfThreads();
+
+        /** The number of threads Execute will use for the given request.
+          * Per thread scratch space should be sized with this. **/
+        static int GetNumberOfThreads(int numberOfThreads);
+};
+
+#endif // PARALLELRANGE_H
@@ -0,0 +1,231 @@
+/*
+ * PointKdTree.cpp
+ *
+ * Copyright 2013 Seth Gilchrist <seth@fake.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#include "PointKdTree.h"
+#include <algorithm>
+
+namespace
+{
+// ranges of this many points or fewer are searched point by point
+const vtkIdType leafSize = 8;
+
+/** Orders point ids by one coordinate. **/
+struct AxisLess
+{
+    AxisLess(const double* points, int axis) : points(points), axis(axis) {}
+    bool operator()(vtkIdType a, vtkIdType b) const
+    {
+        return points[3*a+axis] < points[3*b+axis];
+    }
+    const double*   points;
+    int             axis;
+};
+
+/** Sort the ids in begin to end-1 into tree order, the middle id split
+  * from the rest along the widest axis of the range. **/
+void BuildRange(const double* points, vtkIdType* ids, unsigned char* axes, vtkIdType begin, vtkIdType end)
+{
+    while (end - begin > leafSize)
+    {
+        double low[3] = {points[3*ids[begin]],points[3*ids[begin]+1],points[3*ids[begin]+2]};
+        double high[3] = {low[0],low[1],low[2]};
+        for (vtkIdType i = begin + 1; i < end; ++i)
+        {
+            const double* x = points + 3*ids[i];
+            for (int c = 0; c < 3; ++c)
+            {
+                low[c] = (x[c] < low[c]) ? x[c] : low[c];
+                high[c] = (x[c] > high[c]) ? x[c] : high[c];
+            }
+        }
+        int axis = 0;
+        for (int c = 1; c < 3; ++c)
+        {
+            if (high[c] - low[c] > high[axis] - low[axis])
+            {
+                axis = c;
+            }
+        }
+
+        vtkIdType middle = begin + (end - begin)/2;
+        std::nth_element(ids + begin,ids + middle,ids + end,AxisLess(points,axis));
+        axes[middle] = static_cast<unsigned char>(axis);
+        BuildRange(points,ids,axes,begin,middle);
+        begin = middle + 1;
+    }
+}
+
+/** The state of one closest point search. **/
+struct ClosestPointSearch
+{
+    const double*           points;
+    const unsigned char*    axes;
+    const double*           x;
+    vtkIdType               closest;
+    double                  dist2;
+
+    void Check(vtkIdType i)
+    {
+        const double* p = points + 3*i;
+        double d2 = (x[0] - p[0])*(x[0] - p[0]) + (x[1] - p[1])*(x[1] - p[1]) + (x[2] - p[2])*(x[2] - p[2]);
+        if (d2 < dist2)
+        {
+            dist2 = d2;
+            closest = i;
+        }
+    }
+
+    void Search(vtkIdType begin, vtkIdType end)
+    {
+        if (end - begin <= leafSize)
+        {
+            for (vtkIdType i = begin; i < end; ++i)
+            {
+                Check(i);
+            }
+            return;
+        }
+        // search the side of the split x is on first, then the other side
+        // only if it could hold something closer
+        vtkIdType middle = begin + (end - begin)/2;
+        int axis = axes[middle];
+        double difference = x[axis] - points[3*middle+axis];
+        Check(middle);
+        if (difference < 0)
+        {
+            Search(begin,middle);
+            if (difference*difference < dist2)
+            {
+                Search(middle + 1,end);
+            }
+        }
+        else
+        {
+            Search(middle + 1,end);
+            if (difference*difference < dist2)
+            {
+                Search(begin,middle);
+            }
+        }
+    }
+};
+
+/** Whether ids and locations read from a cache are inverse orders of the
+  * same ids and every split axis is a coordinate axis. **/
+bool ValidOrder(const std::vector<vtkIdType>& ids, const std::vector<vtkIdType>& locations,
+                const std::vector<unsigned char>& axes)
+{
+    vtkIdType n = ids.size();
+    for (vtkIdType i = 0; i < n; ++i)
+    {
+        if (ids[i] < 0 || ids[i] >= n || locations[ids[i]] != i || axes[i] >= 3)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+}
+
+PointKdTree::PointKdTree()
+{
+}
+
+void PointKdTree::Build(vtkPoints* points)
+{
+    vtkIdType numberOfPoints = points->GetNumberOfPoints();
+    std::vector<double> original(3*numberOfPoints);
+    for (vtkIdType i = 0; i < numberOfPoints; ++i)
+    {
+        points->GetPoint(i,&original[3*i]);
+    }
+
+    m_ids.resize(numberOfPoints);
+    for (vtkIdType i = 0; i < numberOfPoints; ++i)
+    {
+        m_ids[i] = i;
+    }
+    m_axes.assign(numberOfPoints,0);
+    if (numberOfPoints > 0)
+    {
+        BuildRange(&original[0],&m_ids[0],&m_axes[0],0,numberOfPoints);
+    }
+
+    // lay the points out in tree order
+    m_points.resize(3*numberOfPoints);
+    m_locations.resize(numberOfPoints);
+    for (vtkIdType i = 0; i < numberOfPoints; ++i)
+    {
+        std::copy(&original[3*m_ids[i]],&original[3*m_ids[i]] + 3,&m_points[3*i]);
+        m_locations[m_ids[i]] = i;
+    }
+}
+
+vtkIdType PointKdTree::FindClosestPoint(const double x[3], double& dist2) const
+{
+    if (m_ids.empty())
+    {
+        return -1;
+    }
+    ClosestPointSearch search;
+    search.points = &m_points[0];
+    search.axes = &m_axes[0];
+    search.x = x;
+    search.closest = -1;
+    search.dist2 = VTK_DOUBLE_MAX;
+    search.Search(0,m_ids.size());
+    dist2 = search.dist2;
+    // a query with a NaN or infinite coordinate is closer to no point
+    return (search.closest < 0) ? -1 : m_ids[search.closest];
+}
+
+void PointKdTree::Write(BinaryCacheWriter& writer) const
+{
+    writer.Write(m_points);
+    writer.Write(m_ids);
+    writer.Write(m_locations);
+    writer.Write(m_axes);
+}
+
+bool PointKdTree::Read(BinaryCacheReader& reader)
+{
+    if (reader.Read(m_points) && reader.Read(m_ids) && reader.Read(m_locations) && reader.Read(m_axes) &&
+        m_points.size() == 3*m_ids.size() && m_locations.size() == m_ids.size() && m_axes.size() == m_ids.size() &&
+        ValidOrder(m_ids,m_locations,m_axes))
+    {
+        return true;
+    }
+    m_points.clear();
+    m_ids.clear();
+    m_locations.clear();
+    m_axes.clear();
+    return false;
+}
+
+void PointKdTree::GetPoint(vtkIdType id, double x[3]) const
+{
+    const double* p = &m_points[3*m_locations[id]];
+    x[0] = p[0];
+    x[1] = p[1];
+    x[2] = p[2];
+}
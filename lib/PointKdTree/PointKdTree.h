@@ -0,0 +1,74 @@
+/*
+ * PointKdTree.h
+ *
+ * Copyright 2013 Seth Gilchrist <seth@fake.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#ifndef POINTKDTREE_H
+#define POINTKDTREE_H
+
+#include <vector>
+#include <vtkType.h>
+#include <vtkPoints.h>
+#include "../BinaryCache/BinaryCache.h"
+
+/** A k-d tree over a set of points for closest point queries. The tree is
+  * flat: the points are copied into one array in tree order and each
+  * range of it is split at its middle point, along the widest axis of the
+  * range, so the only other storage is the split axis of each middle
+  * point. Once built, FindClosestPoint can be called from several threads
+  * at once. **/
+class PointKdTree
+{
+    public:
+        PointKdTree();
+
+        /** Build the tree over points. The points are copied, so points
+          * may change or be deleted afterwards. **/
+        void Build(vtkPoints* points);
+
+        /** Return the id of the point closest to x, or -1 if the tree is
+          * empty or no point is closer than infinity, as for a NaN or
+          * infinite x. dist2 is set to the squared distance to it. **/
+        vtkIdType FindClosestPoint(const double x[3], double& dist2) const;
+
+        /** The location of the point with the given id. **/
+        void GetPoint(vtkIdType id, double x[3]) const;
+
+        vtkIdType GetNumberOfPoints() const
+        {
+            return m_ids.size();
+        }
+
+        /** Write the built tree to a cache. **/
+        void Write(BinaryCacheWriter& writer) const;
+        /** Read a tree written by Write, in place of building it.
+          * Returns false, leaving the tree empty, if the cache does not
+          * hold a whole, consistent tree. **/
+        bool Read(BinaryCacheReader& reader);
+
+    private:
+        std::vector<double>         m_points;       // the points in tree order
+        std::vector<vtkIdType>      m_ids;          // the id of each point in tree order
+        std::vector<vtkIdType>      m_locations;    // the place in tree order of each id
+        std::vector<unsigned char>  m_axes;         // the split axis of the middle point of each range
+};
+
+#endif // POINTKDTREE_H
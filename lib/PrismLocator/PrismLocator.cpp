@@ -0,0 +1,433 @@
+/*
+ * PrismLocator.cpp
+ *
+ * Copyright 2013 Seth Gilchrist <seth@fake.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#include "PrismLocator.h"
+#include <cmath>
+
+namespace
+{
+// how far outside a prism a point may be, in barycentric and t units, the
+// same as the parametric tolerance vtkWedge uses
+const double prismTolerance = 0.001;
+
+inline double Dot(const double a[3], const double b[3])
+{
+    return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+}
+
+/** Whether the bins of a read locator only hold prisms below
+  * numberOfPrisms and their offsets run in order from 0. **/
+bool ValidBins(const std::vector<vtkIdType>& binOffsets, const std::vector<vtkIdType>& binPrisms,
+               vtkIdType numberOfPrisms)
+{
+    if (!binOffsets.empty() && binOffsets.front() != 0)
+    {
+        return false;
+    }
+    for (size_t b = 1; b < binOffsets.size(); ++b)
+    {
+        if (binOffsets[b] < binOffsets[b-1])
+        {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < binPrisms.size(); ++i)
+    {
+        if (binPrisms[i] < 0 || binPrisms[i] >= numberOfPrisms)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+}
+
+PrismLocator::PrismLocator()
+{
+    m_range[0] = 0;
+    m_range[1] = 1;
+    m_nearest = false;
+    m_idsPerPrism = 3;
+    m_dimensions[0] = 0;
+    m_dimensions[1] = 0;
+}
+
+bool PrismLocator::BuildFromWedges(vtkUnstructuredGrid* volume)
+{
+    m_prisms.clear();
+    m_pointIds.clear();
+    m_binOffsets.clear();
+    m_binPrisms.clear();
+    vtkIdType numberOfCells = volume->GetNumberOfCells();
+    if (numberOfCells == 0)
+    {
+        return false;
+    }
+
+    // the sweep is taken from the first wedge and every wedge must match it
+    m_idsPerPrism = 6;
+    m_pointIds.resize(6*numberOfCells);
+    double sweep[3] = {0,0,0};
+    double tolerance2 = 0;
+    for (vtkIdType i = 0; i < numberOfCells; ++i)
+    {
+        vtkIdType numberOfPoints;
+        vtkIdType* ids;
+        volume->GetCellPoints(i,numberOfPoints,ids);
+        if (volume->GetCellType(i) != VTK_WEDGE || numberOfPoints != 6)
+        {
+            m_pointIds.clear();
+            return false;
+        }
+        for (int k = 0; k < 3; ++k)
+        {
+            double bottom[3];
+            double top[3];
+            volume->GetPoint(ids[k],bottom);
+            volume->GetPoint(ids[k+3],top);
+            double edge[3] = {top[0] - bottom[0],top[1] - bottom[1],top[2] - bottom[2]};
+            if (i == 0 && k == 0)
+            {
+                sweep[0] = edge[0];
+                sweep[1] = edge[1];
+                sweep[2] = edge[2];
+                // allow for the rounding of float points
+                tolerance2 = 1e-8*Dot(sweep,sweep);
+                if (tolerance2 == 0)
+                {
+                    m_pointIds.clear();
+                    return false;
+                }
+            }
+            double difference[3] = {edge[0] - sweep[0],edge[1] - sweep[1],edge[2] - sweep[2]};
+            if (Dot(difference,difference) > tolerance2)
+            {
+                m_pointIds.clear();
+                return false;
+            }
+        }
+        std::copy(ids,ids + 6,&m_pointIds[6*i]);
+    }
+
+    m_range[0] = 0;
+    m_range[1] = 1;
+    m_nearest = false;
+    Build(volume->GetPoints(),sweep);
+    return true;
+}
+
+void PrismLocator::BuildFromSurface(vtkPolyData* surface, const double direction[3])
+{
+    m_prisms.clear();
+    m_pointIds.clear();
+    m_binOffsets.clear();
+    m_binPrisms.clear();
+    m_idsPerPrism = 3;
+
+    // only triangles are used, but prism i stays the i-th polygon so the
+    // caller can match them up
+    vtkCellArray* polys = surface->GetPolys();
+    const vtkIdType* polyData = polys->GetPointer();
+    vtkIdType numberOfEntries = polys->GetNumberOfConnectivityEntries();
+    m_pointIds.reserve(3*polys->GetNumberOfCells());
+    for (vtkIdType location = 0; location < numberOfEntries; location += polyData[location] + 1)
+    {
+        if (polyData[location] == 3)
+        {
+            m_pointIds.insert(m_pointIds.end(),polyData + location + 1,polyData + location + 4);
+        }
+        else
+        {
+            // a degenerate triangle, or a cell with no points, is never found
+            vtkIdType id = (polyData[location] > 0) ? polyData[location + 1] : 0;
+            m_pointIds.insert(m_pointIds.end(),3,id);
+        }
+    }
+    if (m_pointIds.empty() || surface->GetNumberOfPoints() == 0 || Dot(direction,direction) == 0)
+    {
+        m_pointIds.clear();
+        return;
+    }
+    m_range[0] = -1;
+    m_range[1] = 1;
+    m_nearest = true;
+    Build(surface->GetPoints(),direction);
+}
+
+void PrismLocator::Build(vtkPoints* points, const double sweep[3])
+{
+    double length2 = Dot(sweep,sweep);
+    m_sweep[0] = sweep[0]/length2;
+    m_sweep[1] = sweep[1]/length2;
+    m_sweep[2] = sweep[2]/length2;
+
+    // two axes perpendicular to the sweep, starting from the coordinate
+    // axis least aligned with it
+    double length = sqrt(length2);
+    double unit[3] = {sweep[0]/length,sweep[1]/length,sweep[2]/length};
+    int smallest = (fabs(unit[0]) < fabs(unit[1])) ? 0 : 1;
+    smallest = (fabs(unit[smallest]) < fabs(unit[2])) ? smallest : 2;
+    double axis[3] = {0,0,0};
+    axis[smallest] = 1;
+    double projection = Dot(axis,unit);
+    for (int c = 0; c < 3; ++c)
+    {
+        m_axes[0][c] = axis[c] - projection*unit[c];
+    }
+    double axisLength = sqrt(Dot(m_axes[0],m_axes[0]));
+    for (int c = 0; c < 3; ++c)
+    {
+        m_axes[0][c] /= axisLength;
+    }
+    m_axes[1][0] = unit[1]*m_axes[0][2] - unit[2]*m_axes[0][1];
+    m_axes[1][1] = unit[2]*m_axes[0][0] - unit[0]*m_axes[0][2];
+    m_axes[1][2] = unit[0]*m_axes[0][1] - unit[1]*m_axes[0][0];
+
+    // project the triangles and find the bounds of the projection
+    vtkIdType numberOfPrisms = m_pointIds.size()/m_idsPerPrism;
+    m_prisms.resize(numberOfPrisms);
+    std::vector<double> prismBounds(4*numberOfPrisms);
+    m_bounds[0] = m_bounds[2] = VTK_DOUBLE_MAX;
+    m_bounds[1] = m_bounds[3] = -VTK_DOUBLE_MAX;
+    for (vtkIdType i = 0; i < numberOfPrisms; ++i)
+    {
+        const vtkIdType* ids = &m_pointIds[i*m_idsPerPrism];
+        double projected[3][2];
+        Prism& prism = m_prisms[i];
+        for (int k = 0; k < 3; ++k)
+        {
+            double x[3];
+            points->GetPoint(ids[k],x);
+            projected[k][0] = Dot(x,m_axes[0]);
+            projected[k][1] = Dot(x,m_axes[1]);
+            prism.heights[k] = Dot(x,m_sweep);
+        }
+        prism.origin[0] = projected[0][0];
+        prism.origin[1] = projected[0][1];
+        double e1[2] = {projected[1][0] - projected[0][0],projected[1][1] - projected[0][1]};
+        double e2[2] = {projected[2][0] - projected[0][0],projected[2][1] - projected[0][1]};
+        double determinant = e1[0]*e2[1] - e1[1]*e2[0];
+        double* bounds = &prismBounds[4*i];
+        if (determinant == 0)
+        {
+            // a triangle seen edge on along the sweep holds no points
+            bounds[0] = 1;
+            bounds[1] = 0;
+            continue;
+        }
+        prism.inverse[0] = e2[1]/determinant;
+        prism.inverse[1] = -e2[0]/determinant;
+        prism.inverse[2] = -e1[1]/determinant;
+        prism.inverse[3] = e1[0]/determinant;
+
+        // pad the bounds so points within the tolerance are binned too
+        for (int c = 0; c < 2; ++c)
+        {
+            double low = projected[0][c];
+            double high = projected[0][c];
+            for (int k = 1; k < 3; ++k)
+            {
+                low = (projected[k][c] < low) ? projected[k][c] : low;
+                high = (projected[k][c] > high) ? projected[k][c] : high;
+            }
+            double pad = 2*prismTolerance*(high - low);
+            bounds[2*c] = low - pad;
+            bounds[2*c+1] = high + pad;
+            m_bounds[2*c] = (bounds[2*c] < m_bounds[2*c]) ? bounds[2*c] : m_bounds[2*c];
+            m_bounds[2*c+1] = (bounds[2*c+1] > m_bounds[2*c+1]) ? bounds[2*c+1] : m_bounds[2*c+1];
+        }
+    }
+    if (m_bounds[0] > m_bounds[1])
+    {
+        m_dimensions[0] = m_dimensions[1] = 0;
+        return;
+    }
+
+    // about two prisms to a bin, with square-ish bins
+    double width = m_bounds[1] - m_bounds[0];
+    double height = m_bounds[3] - m_bounds[2];
+    double targetBins = (numberOfPrisms > 2) ? numberOfPrisms/2.0 : 1.0;
+    double aspect = (width > 0 && height > 0) ? width/height : 1.0;
+    double columns = sqrt(targetBins*aspect);
+    columns = (columns < 1) ? 1 : ((columns > 16384) ? 16384 : columns);
+    double rows = targetBins/columns;
+    rows = (rows < 1) ? 1 : ((rows > 16384) ? 16384 : rows);
+    m_dimensions[0] = static_cast<int>(columns);
+    m_dimensions[1] = static_cast<int>(rows);
+    m_binSize[0] = (width > 0) ? width/m_dimensions[0] : 1;
+    m_binSize[1] = (height > 0) ? height/m_dimensions[1] : 1;
+
+    // count the prisms in each bin, turn the counts into offsets and fill
+    m_binOffsets.assign(static_cast<size_t>(m_dimensions[0])*m_dimensions[1] + 1,0);
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        for (vtkIdType i = 0; i < numberOfPrisms; ++i)
+        {
+            const double* bounds = &prismBounds[4*i];
+            if (bounds[0] > bounds[1])
+            {
+                continue;
+            }
+            int low = GetBin(bounds[0],bounds[2]);
+            int high = GetBin(bounds[1],bounds[3]);
+            for (int row = low/m_dimensions[0]; row <= high/m_dimensions[0]; ++row)
+            {
+                for (int column = low%m_dimensions[0]; column <= high%m_dimensions[0]; ++column)
+                {
+                    vtkIdType bin = static_cast<vtkIdType>(row)*m_dimensions[0] + column;
+                    if (pass == 0)
+                    {
+                        ++m_binOffsets[bin+1];
+                    }
+                    else
+                    {
+                        m_binPrisms[m_binOffsets[bin]++] = i;
+                    }
+                }
+            }
+        }
+        if (pass == 0)
+        {
+            for (size_t b = 1; b < m_binOffsets.size(); ++b)
+            {
+                m_binOffsets[b] += m_binOffsets[b-1];
+            }
+            m_binPrisms.resize(m_binOffsets.back());
+        }
+    }
+    // the fill moved each offset to the start of the next bin
+    for (size_t b = m_binOffsets.size() - 1; b > 0; --b)
+    {
+        m_binOffsets[b] = m_binOffsets[b-1];
+    }
+    m_binOffsets[0] = 0;
+}
+
+int PrismLocator::GetBin(double u, double v) const
+{
+    int column = static_cast<int>((u - m_bounds[0])/m_binSize[0]);
+    int row = static_cast<int>((v - m_bounds[2])/m_binSize[1]);
+    column = (column < 0) ? 0 : ((column >= m_dimensions[0]) ? m_dimensions[0] - 1 : column);
+    row = (row < 0) ? 0 : ((row >= m_dimensions[1]) ? m_dimensions[1] - 1 : row);
+    return row*m_dimensions[0] + column;
+}
+
+vtkIdType PrismLocator::FindPrism(const double x[3], double barycentrics[3], double& t) const
+{
+    if (m_binOffsets.empty())
+    {
+        return -1;
+    }
+    double u = Dot(x,m_axes[0]);
+    double v = Dot(x,m_axes[1]);
+    if (u < m_bounds[0] || u > m_bounds[1] || v < m_bounds[2] || v > m_bounds[3])
+    {
+        return -1;
+    }
+    double height = Dot(x,m_sweep);
+
+    // a prism the point is inside is used straight away, or the nearest one
+    // along the sweep for a surface. Otherwise the first one the point is
+    // within the tolerance of.
+    vtkIdType found = -1;
+    bool foundInside = false;
+    double foundDistance = VTK_DOUBLE_MAX;
+    int bin = GetBin(u,v);
+    for (vtkIdType b = m_binOffsets[bin]; b < m_binOffsets[bin+1]; ++b)
+    {
+        vtkIdType i = m_binPrisms[b];
+        const Prism& prism = m_prisms[i];
+        double du = u - prism.origin[0];
+        double dv = v - prism.origin[1];
+        double b1 = prism.inverse[0]*du + prism.inverse[1]*dv;
+        double b2 = prism.inverse[2]*du + prism.inverse[3]*dv;
+        double b0 = 1 - b1 - b2;
+        if (b0 < -prismTolerance || b1 < -prismTolerance || b2 < -prismTolerance)
+        {
+            continue;
+        }
+        double cT = height - (b0*prism.heights[0] + b1*prism.heights[1] + b2*prism.heights[2]);
+        if (cT < m_range[0] - prismTolerance || cT > m_range[1] + prismTolerance)
+        {
+            continue;
+        }
+        bool inside = b0 >= 0 && b1 >= 0 && b2 >= 0 && cT >= m_range[0] && cT <= m_range[1];
+        double distance = m_nearest ? fabs(cT) : 0;
+        if ((inside && !foundInside) || (inside == foundInside && distance < foundDistance))
+        {
+            found = i;
+            foundInside = inside;
+            foundDistance = distance;
+            barycentrics[0] = b0;
+            barycentrics[1] = b1;
+            barycentrics[2] = b2;
+            t = cT;
+            if (inside && !m_nearest)
+            {
+                break;
+            }
+        }
+    }
+    return found;
+}
+
+void PrismLocator::Write(BinaryCacheWriter& writer) const
+{
+    int settings[4] = {m_nearest ? 1 : 0,m_idsPerPrism,m_dimensions[0],m_dimensions[1]};
+    writer.Write(settings,4);
+    writer.Write(m_sweep,3);
+    writer.Write(&m_axes[0][0],6);
+    writer.Write(m_range,2);
+    writer.Write(m_bounds,4);
+    writer.Write(m_binSize,2);
+    writer.Write(m_pointIds);
+    writer.Write(m_prisms);
+    writer.Write(m_binOffsets);
+    writer.Write(m_binPrisms);
+}
+
+bool PrismLocator::Read(BinaryCacheReader& reader)
+{
+    int settings[4];
+    if (reader.Read(settings,4) && reader.Read(m_sweep,3) && reader.Read(&m_axes[0][0],6) && reader.Read(m_range,2) &&
+        reader.Read(m_bounds,4) && reader.Read(m_binSize,2) && reader.Read(m_pointIds) && reader.Read(m_prisms) &&
+        reader.Read(m_binOffsets) && reader.Read(m_binPrisms) && (settings[1] == 3 || settings[1] == 6) &&
+        settings[2] >= 0 && settings[3] >= 0 && m_pointIds.size() == m_prisms.size()*settings[1] &&
+        (m_binOffsets.empty() || (m_binOffsets.size() == static_cast<size_t>(settings[2])*settings[3] + 1 &&
+                                  m_binOffsets.back() == static_cast<vtkIdType>(m_binPrisms.size()))) &&
+        ValidBins(m_binOffsets,m_binPrisms,m_prisms.size()))
+    {
+        m_nearest = settings[0] != 0;
+        m_idsPerPrism = settings[1];
+        m_dimensions[0] = settings[2];
+        m_dimensions[1] = settings[3];
+        return true;
+    }
+    m_prisms.clear();
+    m_pointIds.clear();
+    m_binOffsets.clear();
+    m_binPrisms.clear();
+    m_dimensions[0] = 0;
+    m_dimensions[1] = 0;
+    return false;
+}
@@ -0,0 +1,124 @@
+/*
+ * PrismLocator.h
+ *
+ * Copyright 2013 Seth Gilchrist <seth@fake.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#ifndef PRISMLOCATOR_H
+#define PRISMLOCATOR_H
+
+#include <vector>
+#include <vtkType.h>
+#include <vtkCellType.h>
+#include <vtkPolyData.h>
+#include <vtkUnstructuredGrid.h>
+#include "../BinaryCache/BinaryCache.h"
+
+/** Locates points in prisms made by sweeping triangles along a single
+  * vector, such as the wedges made by CompareSurfaces::ExtrudeSurface.
+  * The triangles are projected onto the plane perpendicular to the sweep
+  * and binned in a uniform 2D grid, so a query is one bin lookup and a
+  * barycentric test against the few triangles in the bin. Once built,
+  * FindPrism can be called from several threads at once. **/
+class PrismLocator
+{
+    public:
+        PrismLocator();
+
+        /** Build from the wedges of volume. Every cell must be a wedge
+          * whose top points (3,4,5) are its bottom points (0,1,2) moved by
+          * the same vector. Returns false, leaving the locator empty, if
+          * the volume is not such a sweep. Prism i is then wedge i and
+          * points are only found between the bottom and top faces. **/
+        bool BuildFromWedges(vtkUnstructuredGrid* volume);
+
+        /** Build from the triangles of surface swept along direction.
+          * Points are found up to one direction length either side of
+          * the surface, so t is between -1 and 1. Where a point lies over
+          * more than one triangle, the nearest is used. Prism i is the
+          * i-th polygon of the surface polys and only triangles are
+          * found. **/
+        void BuildFromSurface(vtkPolyData* surface, const double direction[3]);
+
+        /** Find the prism containing x. Returns the prism, or -1 if x is
+          * in none. barycentrics are the weights of the three triangle
+          * points where the sweep through x crosses the triangle and t is
+          * the distance along the sweep vector from there to x, so 0 at
+          * the bottom of a wedge and 1 at its top. As with vtkWedge,
+          * points up to 0.001 outside a prism in these coordinates are
+          * found if they are in no other prism. **/
+        vtkIdType FindPrism(const double x[3], double barycentrics[3], double& t) const;
+
+        /** The point ids of a prism, six for wedges (bottom then top) and
+          * three for surface triangles. **/
+        const vtkIdType* GetPrismPointIds(vtkIdType prism) const
+        {
+            return &m_pointIds[prism*m_idsPerPrism];
+        }
+
+        /** The number of point ids per prism. **/
+        int GetIdsPerPrism() const
+        {
+            return m_idsPerPrism;
+        }
+
+        vtkIdType GetNumberOfPrisms() const
+        {
+            return m_prisms.size();
+        }
+
+        /** Write the built locator to a cache. **/
+        void Write(BinaryCacheWriter& writer) const;
+        /** Read a locator written by Write, in place of building it.
+          * Returns false, leaving the locator empty, if the cache does not
+          * hold a whole locator or its bins name prisms it does not have. **/
+        bool Read(BinaryCacheReader& reader);
+
+    private:
+        // a triangle projected into the plane, with what is needed to
+        // turn a projected point into barycentrics and t
+        struct Prism
+        {
+            double      origin[2];      // the projection of the first point
+            double      inverse[4];     // inverts the edges from the first point
+            double      heights[3];     // each point along the sweep, in sweep lengths
+        };
+
+        /** Project the triangles given by pointIds, m_idsPerPrism per
+          * triangle with the triangle points first, and bin them. **/
+        void Build(vtkPoints* points, const double sweep[3]);
+        /** The bin of a projected point, clamped to the grid. **/
+        int GetBin(double u, double v) const;
+
+        double                      m_sweep[3];         // the sweep over its squared length
+        double                      m_axes[2][3];       // the plane the triangles are projected into
+        double                      m_range[2];         // the t points are found between
+        bool                        m_nearest;          // use the nearest prism rather than the first
+        int                         m_idsPerPrism;
+        std::vector<vtkIdType>      m_pointIds;
+        std::vector<Prism>          m_prisms;
+        double                      m_bounds[4];
+        int                         m_dimensions[2];
+        double                      m_binSize[2];
+        std::vector<vtkIdType>      m_binOffsets;       // the prisms in bin b are m_binPrisms[m_binOffsets[b]...m_binOffsets[b+1]-1]
+        std::vector<vtkIdType>      m_binPrisms;
+};
+
+#endif // PRISMLOCATOR_H
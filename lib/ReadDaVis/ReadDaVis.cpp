@@ -18,6 +18,531 @@
 //      MA 02110-1301, USA.
 
 #include "ReadDaVis.h"
+#include <boost/cstdint.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/scoped_array.hpp>
+#include <vtkCallbackCommand.h>
+
+namespace
+{
+// the powers of ten that can be represented exactly by a double
+const double exactPowersOfTen[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+inline bool IsSeparator(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+/** Return the end of the line starting at p, either the newline or end. **/
+inline const char* FindLineEnd(const char* p, const char* end)
+{
+    const char* lineEnd = static_cast<const char*>(memchr(p,'\n',end - p));
+    return lineEnd ? lineEnd : end;
+}
+
+/** Return the start of the line following lineEnd. **/
+inline const char* NextLine(const char* lineEnd, const char* end)
+{
+    return lineEnd == end ? end : lineEnd + 1;
+}
+
+/** Convert a byte count and time to MB/s. **/
+inline double ReadThroughput(double bytes, double seconds)
+{
+    return bytes/1.0e6/(seconds > 1e-9 ? seconds : 1e-9);
+}
+
+/** What a cache written by ReadDaVis::WriteCacheFile is keyed on: the
+  * layout of the cache, the scalar type and the size and modification
+  * time of the parsed file. **/
+struct DaVisCacheSource
+{
+    boost::uint32_t version;
+    boost::uint32_t scalarType;     // the VTK type of the scalars
+    boost::uint64_t sourceSize;     // the size of the parsed file
+    boost::int64_t  sourceTime;     // the modification time of the parsed file
+};
+
+/** Find the cache key of fileName read as scalarType. Returns false if
+  * the file can't be found. **/
+bool GetCacheKey(std::string fileName, int scalarType, boost::uint64_t& key)
+{
+    DaVisCacheSource source;
+    memset(&source,0,sizeof(source));
+    source.version = 2;
+    source.scalarType = scalarType;
+    boost::system::error_code error;
+    source.sourceSize = boost::filesystem::file_size(fileName,error);
+    if (error)
+    {
+        return false;
+    }
+    source.sourceTime = boost::filesystem::last_write_time(fileName,error);
+    key = BinaryCache::HashBytes(&source,sizeof(source),BinaryCache::GetInitialHash());
+    return !error;
+}
+
+/** Delete the mapped file given as clientData, once the array it backs
+  * is deleted. **/
+void ReleaseMappedFile(vtkObject*, unsigned long, void* clientData, void*)
+{
+    delete static_cast<boost::iostreams::mapped_file*>(clientData);
+}
+
+/** An array of the next numberOfValues values of reader, left in the
+  * mapped file rather than copied. The array keeps the file mapped until
+  * it is deleted. Returns null if the next array is not numberOfValues
+  * values of type T. **/
+template <class TArray, class T>
+vtkSmartPointer<vtkDataArray> NewMappedArray(BinaryCacheReader& reader, size_t numberOfValues)
+{
+    T* values = reader.Map<T>(numberOfValues);
+    if (!values)
+    {
+        return 0;
+    }
+    vtkSmartPointer<TArray> array = vtkSmartPointer<TArray>::New();
+    array->SetArray(values,numberOfValues,1);
+    vtkSmartPointer<vtkCallbackCommand> release = vtkSmartPointer<vtkCallbackCommand>::New();
+    release->SetCallback(ReleaseMappedFile);
+    release->SetClientData(new boost::iostreams::mapped_file(reader.GetFile()));
+    array->AddObserver(vtkCommand::DeleteEvent,release);
+    return array;
+}
+
+/** Parse the number at p and return a pointer to the end of its token,
+  * giving the same value as atof. Mantissas of up to 15 digits with a
+  * small exponent are exact as a double so they are converted directly
+  * (Clinger's fast path), anything else is copied and given to strtod. **/
+const char* ParseDouble(const char* p, const char* end, double& value)
+{
+    const char* start = p;
+    bool negative = false;
+    if (p != end && (*p == '-' || *p == '+'))
+    {
+        negative = (*p == '-');
+        ++p;
+    }
+
+    boost::uint64_t mantissa = 0;
+    int digits = 0;         // significant digits held in mantissa
+    int exponent = 0;       // decimal exponent of mantissa
+    bool anyDigits = false;
+    bool truncated = false; // digits were dropped from the mantissa
+    for (; p != end && *p >= '0' && *p <= '9'; ++p)
+    {
+        anyDigits = true;
+        if (digits < 19)
+        {
+            mantissa = mantissa*10 + (*p - '0');
+            if (mantissa != 0) {++digits;}
+        }
+        else
+        {
+            ++exponent;
+            truncated = truncated || *p != '0';
+        }
+    }
+    if (p != end && *p == '.')
+    {
+        for (++p; p != end && *p >= '0' && *p <= '9'; ++p)
+        {
+            anyDigits = true;
+            if (digits < 19)
+            {
+                mantissa = mantissa*10 + (*p - '0');
+                if (mantissa != 0) {++digits;}
+                --exponent;
+            }
+            else
+            {
+                truncated = truncated || *p != '0';
+            }
+        }
+    }
+    if (anyDigits && p != end && (*p == 'e' || *p == 'E'))
+    {
+        const char* e = p + 1;
+        bool negativeExponent = false;
+        if (e != end && (*e == '-' || *e == '+'))
+        {
+            negativeExponent = (*e == '-');
+            ++e;
+        }
+        if (e != end && *e >= '0' && *e <= '9')
+        {
+            int explicitExponent = 0;
+            for (; e != end && *e >= '0' && *e <= '9'; ++e)
+            {
+                if (explicitExponent < 10000) {explicitExponent = explicitExponent*10 + (*e - '0');}
+            }
+            exponent += negativeExponent ? -explicitExponent : explicitExponent;
+            p = e;
+        }
+    }
+
+    // skip whatever is left of the token, atof ignores it too
+    const char* tokenEnd = p;
+    while (tokenEnd != end && !IsSeparator(*tokenEnd) && *tokenEnd != '\n') {++tokenEnd;}
+
+    if (anyDigits && !truncated && digits <= 15 && exponent >= -22 && exponent <= 22)
+    {
+        value = static_cast<double>(mantissa);
+        value = exponent < 0 ? value/exactPowersOfTen[-exponent] : value*exactPowersOfTen[exponent];
+        value = negative ? -value : value;
+        return tokenEnd;
+    }
+
+    // slow path for long mantissas, large exponents, inf and nan
+    char buffer[64];
+    size_t length = tokenEnd - start;
+    length = length < sizeof(buffer) - 1 ? length : sizeof(buffer) - 1;
+    memcpy(buffer,start,length);
+    buffer[length] = '\0';
+    value = strtod(buffer,0);
+    return tokenEnd;
+}
+
+/** Parse up to count values from the line [p,lineEnd) into row, moving
+  * stride values through row between each one. Values missing from the
+  * line are set to zero. **/
+template <class T>
+void ParseRow(const char* p, const char* lineEnd, T* row, vtkIdType stride, int count)
+{
+    int j = 0;
+    while (j < count)
+    {
+        while (p != lineEnd && IsSeparator(*p)) {++p;}
+        if (p == lineEnd) {break;}
+        double value;
+        p = ParseDouble(p,lineEnd,value);
+        row[j*stride] = static_cast<T>(value);
+        ++j;
+    }
+    for (; j < count; ++j)
+    {
+        row[j*stride] = 0;
+    }
+}
+
+// files are only split into chunks of at least this many bytes
+const vtkIdType minimumChunkSize = 1 << 20;
+
+/** Counts the lines that start in each chunk of a file. The count for
+  * chunk k is put in lineCounts[k+1] so a running sum gives the row
+  * each chunk starts at. **/
+class LineCounter : public ParallelRangeFunctor
+{
+public:
+    LineCounter(const std::vector<const char*>& chunkStarts, std::vector<vtkIdType>& lineCounts)
+        : m_chunkStarts(chunkStarts), m_lineCounts(lineCounts) {}
+
+    void Execute(vtkIdType begin, vtkIdType end, int)
+    {
+        for (vtkIdType k = begin; k < end; ++k)
+        {
+            vtkIdType lines = 0;
+            const char* p = m_chunkStarts[k];
+            const char* chunkEnd = m_chunkStarts[k+1];
+            while (p != chunkEnd)
+            {
+                p = NextLine(FindLineEnd(p,chunkEnd),chunkEnd);
+                ++lines;
+            }
+            m_lineCounts[k+1] = lines;
+        }
+    }
+
+private:
+    const std::vector<const char*>& m_chunkStarts;
+    std::vector<vtkIdType>&         m_lineCounts;
+};
+
+/** Parses the rows in each chunk of a file into the image scalars. **/
+template <class T>
+class ChunkParser : public ParallelRangeFunctor
+{
+public:
+    ChunkParser(const std::vector<const char*>& chunkStarts, const std::vector<vtkIdType>& firstRows,
+                T* scalars, int xDimension, int yDimension)
+        : m_chunkStarts(chunkStarts), m_firstRows(firstRows), m_scalars(scalars),
+          m_xDimension(xDimension), m_yDimension(yDimension) {}
+
+    void Execute(vtkIdType begin, vtkIdType end, int)
+    {
+        for (vtkIdType k = begin; k < end; ++k)
+        {
+            vtkIdType i = m_firstRows[k];
+            const char* p = m_chunkStarts[k];
+            const char* chunkEnd = m_chunkStarts[k+1];
+            while (p != chunkEnd && i < m_xDimension)
+            {
+                const char* lineEnd = FindLineEnd(p,chunkEnd);
+                ParseRow(p,lineEnd,m_scalars + i,m_xDimension,m_yDimension);
+                p = NextLine(lineEnd,chunkEnd);
+                ++i;
+            }
+        }
+    }
+
+private:
+    const std::vector<const char*>& m_chunkStarts;
+    const std::vector<vtkIdType>&   m_firstRows;
+    T*                              m_scalars;
+    int                             m_xDimension;
+    int                             m_yDimension;
+};
+
+/** Parse the chunks of a file into scalars, then zero the rows missing
+  * from a short file. **/
+template <class T>
+void ParseChunks(const std::vector<const char*>& chunkStarts, const std::vector<vtkIdType>& firstRows,
+                 T* scalars, int xDimension, int yDimension, int numberOfThreads)
+{
+    // each line holds the values for one x index, the point (i,j) is
+    // stored at i + j*xDimension
+    ChunkParser<T> parser(chunkStarts,firstRows,scalars,xDimension,yDimension);
+    ParallelRange::Execute(chunkStarts.size() - 1,&parser,1,numberOfThreads);
+
+    const char* end = chunkStarts.back();
+    for (vtkIdType i = firstRows.back(); i < xDimension; ++i)
+    {
+        ParseRow(end,end,scalars + i,xDimension,yDimension);
+    }
+}
+
+/** Create an empty single component array of the given scalar type. **/
+vtkSmartPointer<vtkDataArray> NewScalarArray(int scalarType)
+{
+    vtkSmartPointer<vtkDataArray> scalarArray;
+    if (scalarType == VTK_FLOAT)
+    {
+        scalarArray = vtkSmartPointer<vtkFloatArray>::New();
+    }
+    else
+    {
+        scalarArray = vtkSmartPointer<vtkDoubleArray>::New();
+    }
+    scalarArray->SetNumberOfComponents(1);
+    return scalarArray;
+}
+
+/** Split the grid square (i,j) (i+1,j) (i+1,j+1) (i,j+1) along its
+  * diagonal, where ids0 and ids1 are the point ids of rows i and i+1 (-1
+  * for an invalid point). The two triangles are written to cell in cell
+  * array format. Returns false, writing nothing, if a corner is invalid. **/
+inline bool GridSquareTriangles(const vtkIdType* ids0, const vtkIdType* ids1, int j, bool flip, vtkIdType* cell)
+{
+    if (ids0[j] < 0 || ids1[j] < 0 || ids1[j+1] < 0 || ids0[j+1] < 0)
+    {
+        return false;
+    }
+    cell[0] = 3;
+    cell[1] = ids0[j];
+    cell[2] = flip ? ids1[j+1] : ids1[j];
+    cell[3] = flip ? ids1[j] : ids1[j+1];
+    cell[4] = 3;
+    cell[5] = ids0[j];
+    cell[6] = flip ? ids0[j+1] : ids1[j+1];
+    cell[7] = flip ? ids1[j+1] : ids0[j+1];
+    return true;
+}
+
+/** Builds the grid triangulation in CreateGridSurface. Each stage is
+  * run over the rows of the grid in parallel, the counting stages put
+  * their count for row i in rowOffsets[i+1] so a running sum gives the
+  * first point or triangle of each row. **/
+template <class T>
+class GridSurfaceBuilder : public ParallelRangeFunctor
+{
+public:
+    enum Stage {CountPoints, FillPoints, CountTriangles, FillTriangles};
+
+    void Execute(vtkIdType begin, vtkIdType end, int)
+    {
+        for (vtkIdType i = begin; i < end; ++i)
+        {
+            switch (stage)
+            {
+                case CountPoints: CountRowPoints(i); break;
+                case FillPoints: FillRowPoints(i); break;
+                case CountTriangles: CountRowTriangles(i); break;
+                case FillTriangles: FillRowTriangles(i); break;
+            }
+        }
+    }
+
+    Stage                   stage;
+    int                     xEnd;
+    int                     yEnd;
+    const T*                heights;
+    vtkIdType               heightStride;
+    std::vector<const T*>   strains;    // the mask uses the first
+    std::vector<vtkIdType>  strainStrides;
+    const double*           origin;
+    const double*           spacing;
+    bool                    flip;
+    std::vector<vtkIdType>  rowOffsets;
+    std::vector<vtkIdType>  pointIds;   // the surface point at (i,j), or -1
+    float*                  points;
+    std::vector<T*>         values;     // one array for each strain grid
+    vtkIdType*              connectivity;
+
+private:
+    // a point is kept if both the height and strain are non-zero
+    bool IsValid(vtkIdType i, int j)
+    {
+        return heights[i + j*heightStride] != 0 && strains[0][i + j*strainStrides[0]] != 0;
+    }
+
+    void CountRowPoints(vtkIdType i)
+    {
+        vtkIdType count = 0;
+        for (int j = 0; j < yEnd; ++j)
+        {
+            count += IsValid(i,j) ? 1 : 0;
+        }
+        rowOffsets[i+1] = count;
+    }
+
+    void FillRowPoints(vtkIdType i)
+    {
+        vtkIdType id = rowOffsets[i];
+        vtkIdType* rowIds = &pointIds[i*yEnd];
+        for (int j = 0; j < yEnd; ++j)
+        {
+            if (!IsValid(i,j))
+            {
+                rowIds[j] = -1;
+                continue;
+            }
+            rowIds[j] = id;
+            points[3*id] = origin[0] + i*spacing[0];
+            points[3*id+1] = origin[1] + j*spacing[1];
+            points[3*id+2] = heights[i + j*heightStride];
+            for (size_t k = 0; k < strains.size(); ++k)
+            {
+                values[k][id] = strains[k][i + j*strainStrides[k]];
+            }
+            ++id;
+        }
+    }
+
+    void CountRowTriangles(vtkIdType i)
+    {
+        const vtkIdType* ids0 = &pointIds[i*yEnd];
+        const vtkIdType* ids1 = ids0 + yEnd;
+        vtkIdType count = 0;
+        for (int j = 0; j < yEnd - 1; ++j)
+        {
+            count += (ids0[j] >= 0 && ids1[j] >= 0 && ids1[j+1] >= 0 && ids0[j+1] >= 0) ? 2 : 0;
+        }
+        rowOffsets[i+1] = count;
+    }
+
+    void FillRowTriangles(vtkIdType i)
+    {
+        const vtkIdType* ids0 = &pointIds[i*yEnd];
+        const vtkIdType* ids1 = ids0 + yEnd;
+        vtkIdType* cell = connectivity + 4*rowOffsets[i];
+        for (int j = 0; j < yEnd - 1; ++j)
+        {
+            if (GridSquareTriangles(ids0,ids1,j,flip,cell))
+            {
+                cell += 8;
+            }
+        }
+    }
+};
+
+/** Triangulate the height and strain grids, of scalar type T, using the
+  * grid connectivity. Each strain grid becomes a point array. **/
+template <class T>
+vtkSmartPointer<vtkPolyData> BuildGridSurface(vtkImageData* heightData, const std::vector<vtkImageData*>& strainGrids,
+                                              const std::vector<std::string>& arrayNames, int numberOfThreads)
+{
+    // find out which point set has fewer points
+    int* heightDimensions = heightData->GetDimensions();
+    GridSurfaceBuilder<T> builder;
+    builder.xEnd = heightDimensions[0];
+    builder.yEnd = heightDimensions[1];
+    builder.heights = static_cast<T*>(heightData->GetScalarPointer());
+    builder.heightStride = heightDimensions[0];
+    for (size_t k = 0; k < strainGrids.size(); ++k)
+    {
+        int* strainDimensions = strainGrids[k]->GetDimensions();
+        builder.xEnd = (builder.xEnd > strainDimensions[0]) ? strainDimensions[0] : builder.xEnd;
+        builder.yEnd = (builder.yEnd > strainDimensions[1]) ? strainDimensions[1] : builder.yEnd;
+        builder.strains.push_back(static_cast<T*>(strainGrids[k]->GetScalarPointer()));
+        builder.strainStrides.push_back(strainDimensions[0]);
+    }
+    builder.origin = heightData->GetOrigin();
+    builder.spacing = heightData->GetSpacing();
+    // keep the triangles counter clockwise in x-y, like vtkDelaunay2D
+    builder.flip = builder.spacing[0]*builder.spacing[1] < 0;
+    if (builder.xEnd < 1 || builder.yEnd < 1)
+    {
+        return vtkSmartPointer<vtkPolyData>::New();
+    }
+
+    // count the valid points in each row and turn the counts into offsets
+    builder.rowOffsets.assign(builder.xEnd + 1,0);
+    builder.pointIds.resize(static_cast<size_t>(builder.xEnd)*builder.yEnd);
+    builder.stage = GridSurfaceBuilder<T>::CountPoints;
+    ParallelRange::Execute(builder.xEnd,&builder,0,numberOfThreads);
+    for (int i = 0; i < builder.xEnd; ++i)
+    {
+        builder.rowOffsets[i+1] += builder.rowOffsets[i];
+    }
+
+    // fill the points and strains in the same order the Delaunay mode uses
+    vtkSmartPointer<vtkPoints> surfacePoints = vtkSmartPointer<vtkPoints>::New();
+    surfacePoints->SetDataTypeToFloat();
+    surfacePoints->SetNumberOfPoints(builder.rowOffsets[builder.xEnd]);
+    std::vector<vtkSmartPointer<vtkDataArray> > surfaceArrays;
+    for (size_t k = 0; k < strainGrids.size(); ++k)
+    {
+        vtkSmartPointer<vtkDataArray> surfaceArray = NewScalarArray(heightData->GetScalarType());
+        surfaceArray->SetNumberOfTuples(builder.rowOffsets[builder.xEnd]);
+        surfaceArray->SetName(arrayNames[k].c_str());
+        builder.values.push_back(static_cast<T*>(surfaceArray->GetVoidPointer(0)));
+        surfaceArrays.push_back(surfaceArray);
+    }
+    builder.points = static_cast<float*>(surfacePoints->GetVoidPointer(0));
+    builder.stage = GridSurfaceBuilder<T>::FillPoints;
+    ParallelRange::Execute(builder.xEnd,&builder,0,numberOfThreads);
+
+    // count the triangles between each pair of rows, then fill them
+    builder.rowOffsets.assign(builder.xEnd,0);
+    builder.stage = GridSurfaceBuilder<T>::CountTriangles;
+    ParallelRange::Execute(builder.xEnd - 1,&builder,0,numberOfThreads);
+    for (int i = 0; i < builder.xEnd - 1; ++i)
+    {
+        builder.rowOffsets[i+1] += builder.rowOffsets[i];
+    }
+    vtkIdType numberOfTriangles = builder.rowOffsets[builder.xEnd - 1];
+    vtkSmartPointer<vtkIdTypeArray> connectivity = vtkSmartPointer<vtkIdTypeArray>::New();
+    connectivity->SetNumberOfValues(4*numberOfTriangles);
+    builder.connectivity = connectivity->GetPointer(0);
+    builder.stage = GridSurfaceBuilder<T>::FillTriangles;
+    ParallelRange::Execute(builder.xEnd - 1,&builder,0,numberOfThreads);
+
+    vtkSmartPointer<vtkCellArray> triangles = vtkSmartPointer<vtkCellArray>::New();
+    triangles->SetCells(numberOfTriangles,connectivity);
+    vtkSmartPointer<vtkPolyData> surface = vtkSmartPointer<vtkPolyData>::New();
+    surface->SetPoints(surfacePoints);
+    surface->SetPolys(triangles);
+    for (size_t k = 0; k < surfaceArrays.size(); ++k)
+    {
+        surface->GetPointData()->AddArray(surfaceArrays[k]);
+    }
+    return surface;
+}
+}
+
 
 /** Constructor **/
 ReadDaVis::ReadDaVis()
@@ -27,6 +552,14 @@ ReadDaVis::ReadDaVis()
 m_heightData  = vtkSmartPointer<vtkImageData>::New();
 m_strainData  = vtkSmartPointer<vtkImageData>::New();
 m_surface     = vtkSmartPointer<vtkPolyData>::New();
+m_mappedParsing = true;
+m_numberOfThreads = 0;
+m_gridTriangulation = false;
+m_binaryCache = false;
+m_singlePrecision = false;
+m_heightReadRate = 0;
+m_strainReadRate = 0;
+m_stageTimer = 0;
 //m_surface       = vtkSmartPointer<vtkUnstructuredGrid>::New();
 }
 
@@ -44,37 +577,250 @@ void ReadDaVis::SetStrainFileName( std::string fileName )
     if (m_strainFileName.compare(fileName) != 0) {m_strainFileName = fileName;}
 }
 
+void ReadDaVis::AddStrainComponent( std::string fileName, std::string arrayName )
+{
+    m_componentFileNames.push_back(fileName);
+    m_componentNames.push_back(arrayName);
+    m_componentData.push_back(vtkSmartPointer<vtkImageData>::New());
+    m_componentReadRates.push_back(0);
+}
+void ReadDaVis::RemoveAllStrainComponents()
+{
+    m_componentFileNames.clear();
+    m_componentNames.clear();
+    m_componentData.clear();
+    m_componentReadRates.clear();
+}
+int ReadDaVis::GetNumberOfStrainComponents()
+{
+    return m_componentFileNames.size();
+}
+
+void ReadDaVis::SetMappedParsing( bool mapped )
+{
+    if (m_mappedParsing != mapped) {m_mappedParsing = mapped;}
+}
+bool ReadDaVis::GetMappedParsing()
+{
+    return m_mappedParsing;
+}
+
+void ReadDaVis::SetNumberOfThreads( int numberOfThreads )
+{
+    if (m_numberOfThreads != numberOfThreads) {m_numberOfThreads = numberOfThreads;}
+}
+int ReadDaVis::GetNumberOfThreads()
+{
+    return m_numberOfThreads;
+}
+
 void ReadDaVis::ReadHeightFile()
 {
-    ReadFile(m_heightFileName,m_heightData);
+    m_heightReadRate = ParseFile(m_heightFileName,m_heightData,m_numberOfThreads);
 }
 
 void ReadDaVis::ReadStrainFile()
 {
-    ReadFile(m_strainFileName,m_strainData);
+    m_strainReadRate = ParseFile(m_strainFileName,m_strainData,m_numberOfThreads);
+    for (size_t k = 0; k < m_componentFileNames.size(); ++k)
+    {
+        m_componentReadRates[k] = ParseFile(m_componentFileNames[k],m_componentData[k],m_numberOfThreads);
+    }
+}
+
+/** Reads the height, strain and strain component files of a list of
+  * readers. Each file is a job and each job is run on its own thread. **/
+class ReadDaVisFileJobs : public ParallelRangeFunctor
+{
+public:
+    ReadDaVisFileJobs(std::vector<ReadDaVis*>& readers)
+    {
+        // file 0 is the height file, 1 the strain file and 2+ the components
+        for (size_t r = 0; r < readers.size(); ++r)
+        {
+            int numberOfFiles = 2 + readers[r]->m_componentFileNames.size();
+            for (int file = 0; file < numberOfFiles; ++file)
+            {
+                m_jobs.push_back(std::make_pair(readers[r],file));
+            }
+        }
+    }
+
+    vtkIdType GetNumberOfJobs()
+    {
+        return m_jobs.size();
+    }
+
+    void Execute(vtkIdType begin, vtkIdType end, int)
+    {
+        for (vtkIdType k = begin; k < end; ++k)
+        {
+            ReadDaVis* reader = m_jobs[k].first;
+            int file = m_jobs[k].second;
+            // share the reader's parsing threads between all of the files
+            int numberOfThreads = ParallelRange::GetNumberOfThreads(reader->m_numberOfThreads);
+            int numberOfJobs = m_jobs.size();
+            numberOfThreads = (numberOfThreads + numberOfJobs - 1)/numberOfJobs;
+            if (file == 0)
+            {
+                reader->m_heightReadRate = reader->ParseFile(reader->m_heightFileName,reader->m_heightData,numberOfThreads);
+            }
+            else if (file == 1)
+            {
+                reader->m_strainReadRate = reader->ParseFile(reader->m_strainFileName,reader->m_strainData,numberOfThreads);
+            }
+            else
+            {
+                reader->m_componentReadRates[file-2] = reader->ParseFile(reader->m_componentFileNames[file-2],
+                                                                         reader->m_componentData[file-2],numberOfThreads);
+            }
+        }
+    }
+
+private:
+    std::vector<std::pair<ReadDaVis*,int> > m_jobs;
+};
+
+void ReadDaVis::ReadAll()
+{
+    std::vector<ReadDaVis*> readers(1,this);
+    ReadAll(readers);
+}
+
+void ReadDaVis::ReadAll(std::vector<ReadDaVis*> readers)
+{
+    ReadDaVisFileJobs jobs(readers);
+    vtkIdType numberOfJobs = jobs.GetNumberOfJobs();
+    ParallelRange::Execute(numberOfJobs,&jobs,1,numberOfJobs);
 }
 
 void ReadDaVis::ReadFile(std::string fileName, vtkSmartPointer<vtkImageData> pointData)
 {
-    // create a stringstream for passing info to the user
-    std::stringstream msg(" ");
-    // open the file
-    std::ifstream inFile(fileName.c_str());
-    if (!inFile){
-        msg.str(" ");
-        msg << "Cannot open\n" <<fileName<<"\nPlease check the name and try again."<<std::endl;
-        std::cout << msg;
+    ParseFile(fileName,pointData.GetPointer(),m_numberOfThreads);
+}
+
+void ReadDaVis::SetBinaryCache( bool cache )
+{
+    if (m_binaryCache != cache) {m_binaryCache = cache;}
+}
+bool ReadDaVis::GetBinaryCache()
+{
+    return m_binaryCache;
+}
+
+double ReadDaVis::ParseFile(std::string fileName, vtkImageData* pointData, int numberOfThreads)
+{
+    ScopedStage stage(m_stageTimer,"parse");
+    double readRate = -1;
+    if (m_binaryCache)
+    {
+        readRate = ReadCacheFile(fileName,pointData);
+        if (readRate > 0)
+        {
+            return readRate;
+        }
     }
 
-    // Get the header line
-    std::string headerLine;
-    std::getline(inFile,headerLine);
+    if (m_mappedParsing)
+    {
+        readRate = ReadMappedFile(fileName,pointData,numberOfThreads);
+    }
+    else
+    {
+        readRate = ReadStreamFile(fileName,pointData);
+    }
+
+    if (m_binaryCache && readRate > 0)
+    {
+        WriteCacheFile(fileName,pointData);
+    }
+    return readRate;
+}
+
+double ReadDaVis::ReadCacheFile(std::string fileName, vtkImageData* pointData)
+{
+    double startTime = vtkTimerLog::GetUniversalTime();
+    int scalarType = m_singlePrecision ? VTK_FLOAT : VTK_DOUBLE;
+    boost::uint64_t key;
+    BinaryCacheReader cacheReader;
+    boost::int32_t dimensions[2];
+    double origin[2];
+    double spacing[2];
+    if (!GetCacheKey(fileName,scalarType,key) || !cacheReader.Open(fileName + ".cache",key) ||
+        !cacheReader.Read(dimensions,2) || !cacheReader.Read(origin,2) || !cacheReader.Read(spacing,2) ||
+        dimensions[0] < 0 || dimensions[1] < 0)
+    {
+        return -1;
+    }
+
+    // the scalars are used where they are mapped, without copying them
+    size_t numberOfValues = static_cast<size_t>(dimensions[0])*dimensions[1];
+    vtkSmartPointer<vtkDataArray> scalars;
+    if (m_singlePrecision)
+    {
+        scalars = NewMappedArray<vtkFloatArray,float>(cacheReader,numberOfValues);
+    }
+    else
+    {
+        scalars = NewMappedArray<vtkDoubleArray,double>(cacheReader,numberOfValues);
+    }
+    if (!scalars || !cacheReader.AtEnd())
+    {
+        return -1;
+    }
+
+    pointData->SetDimensions(dimensions[0],dimensions[1],1);
+    pointData->SetOrigin(origin[0],origin[1],0);
+    pointData->SetSpacing(spacing[0],spacing[1],1);
+    pointData->SetScalarType(scalarType);
+    pointData->SetNumberOfScalarComponents(1);
+    pointData->GetPointData()->SetScalars(scalars);
+
+    double bytesRead = cacheReader.GetFile().size();
+    return ReadThroughput(bytesRead,vtkTimerLog::GetUniversalTime() - startTime);
+}
+
+void ReadDaVis::WriteCacheFile(std::string fileName, vtkImageData* pointData)
+{
+    boost::uint64_t key;
+    int scalarType = pointData->GetScalarType();
+    if ((scalarType != VTK_FLOAT && scalarType != VTK_DOUBLE) || !GetCacheKey(fileName,scalarType,key))
+    {
+        return;
+    }
+    int* imageDimensions = pointData->GetDimensions();
+    boost::int32_t dimensions[2] = {imageDimensions[0],imageDimensions[1]};
+    double origin[2] = {pointData->GetOrigin()[0],pointData->GetOrigin()[1]};
+    double spacing[2] = {pointData->GetSpacing()[0],pointData->GetSpacing()[1]};
+    size_t numberOfValues = static_cast<size_t>(dimensions[0])*dimensions[1];
+
+    BinaryCacheWriter cacheWriter(fileName + ".cache",key);
+    cacheWriter.Write(dimensions,2);
+    cacheWriter.Write(origin,2);
+    cacheWriter.Write(spacing,2);
+    if (scalarType == VTK_FLOAT)
+    {
+        cacheWriter.Write(static_cast<const float*>(pointData->GetScalarPointer()),numberOfValues);
+    }
+    else
+    {
+        cacheWriter.Write(static_cast<const double*>(pointData->GetScalarPointer()),numberOfValues);
+    }
+    cacheWriter.Commit();
+}
+
+bool ReadDaVis::ReadHeader(std::string headerLine, vtkImageData* pointData)
+{
     std::vector<std::string> headerTokens;
     boost::char_separator<char> sep(" ");
     boost::tokenizer< boost::char_separator<char> > tok(headerLine,sep); // the boost library tokenizer
     for (boost::tokenizer< boost::char_separator<char> >::iterator beg=tok.begin(); beg!=tok.end();++beg){
         headerTokens.push_back(*beg);
     }
+    if (headerTokens.size() < 11)
+    {
+        return false;
+    }
 
     int xDimension = atoi(headerTokens[3].c_str());
     float xScale = atof(headerTokens[6].c_str());
@@ -85,13 +831,43 @@ void ReadDaVis::ReadFile(std::string fileName, vtkSmartPointer<vtkImageData> poi
     pointData->SetDimensions(xDimension,yDimension,1);
     pointData->SetOrigin(xOffset,yOffset,0);
     pointData->SetSpacing(xScale,yScale,1);
+    return true;
+}
+
+double ReadDaVis::ReadStreamFile(std::string fileName, vtkImageData* pointData)
+{
+    double startTime = vtkTimerLog::GetUniversalTime();
+    // open the file
+    std::ifstream inFile(fileName.c_str());
+    if (!inFile){
+        std::cerr << "Cannot open\n" <<fileName<<"\nPlease check the name and try again."<<std::endl;
+        return -1;
+    }
+
+    // Get the header line
+    std::string headerLine;
+    std::getline(inFile,headerLine);
+    double bytesRead = headerLine.size() + 1;
+    if (!ReadHeader(headerLine,pointData))
+    {
+        std::cerr << "Cannot read the header of\n" <<fileName<<std::endl;
+        return -1;
+    }
+    int yDimension = pointData->GetDimensions()[1];
+    pointData->SetScalarType(m_singlePrecision ? VTK_FLOAT : VTK_DOUBLE);
+    pointData->SetNumberOfScalarComponents(1);
+    pointData->AllocateScalars();
+    // rows missing from a short file are left as zeros
+    memset(pointData->GetScalarPointer(),0,pointData->GetNumberOfPoints()*pointData->GetScalarSize());
 
     // now step through the file and create the points
+    boost::char_separator<char> sep(" ");
     std::string cline;
     unsigned int i = 0; // the x point number, will be used with x-scale and x-offest to produce an point
 
     while( std::getline (inFile,cline))
     {
+        bytesRead += cline.size() + 1;
         // break the current line into values of height
         std::vector<double> values;
         boost::tokenizer< boost::char_separator<char> > tok(cline,sep);
@@ -100,6 +876,7 @@ void ReadDaVis::ReadFile(std::string fileName, vtkSmartPointer<vtkImageData> poi
             std::string current = *beg;
             values.push_back(atof(current.c_str()));
         }
+        values.resize(yDimension,0);
         for (int j = 0; j < yDimension; ++j)
         {
             pointData->SetScalarComponentFromDouble(i,j,0,0,values[j]);
@@ -109,20 +886,139 @@ void ReadDaVis::ReadFile(std::string fileName, vtkSmartPointer<vtkImageData> poi
     }
     inFile.close();
 
+    return ReadThroughput(bytesRead,vtkTimerLog::GetUniversalTime() - startTime);
+}
+
+double ReadDaVis::ReadMappedFile(std::string fileName, vtkImageData* pointData, int numberOfThreads)
+{
+    double startTime = vtkTimerLog::GetUniversalTime();
+    // map the file, it is scanned in place without copying any lines
+    boost::iostreams::mapped_file_source inFile;
+    try
+    {
+        inFile.open(fileName);
+    }
+    catch (std::exception&)
+    {
+    }
+    if (!inFile.is_open())
+    {
+        std::cerr << "Cannot open\n" <<fileName<<"\nPlease check the name and try again."<<std::endl;
+        return -1;
+    }
+    const char* p = inFile.data();
+    const char* end = p + inFile.size();
+
+    // Get the header line
+    const char* lineEnd = FindLineEnd(p,end);
+    if (!ReadHeader(std::string(p,lineEnd),pointData))
+    {
+        std::cerr << "Cannot read the header of\n" <<fileName<<std::endl;
+        return -1;
+    }
+    p = NextLine(lineEnd,end);
+
+    // allocate the scalars and write the values straight into them
+    int xDimension = pointData->GetDimensions()[0];
+    int yDimension = pointData->GetDimensions()[1];
+    pointData->SetScalarType(m_singlePrecision ? VTK_FLOAT : VTK_DOUBLE);
+    pointData->SetNumberOfScalarComponents(1);
+    pointData->AllocateScalars();
+    void* scalars = pointData->GetScalarPointer();
+
+    // split the body into chunks that start at the beginning of a line
+    numberOfThreads = ParallelRange::GetNumberOfThreads(numberOfThreads);
+    vtkIdType bodySize = end - p;
+    vtkIdType numberOfChunks = bodySize/minimumChunkSize + 1;
+    numberOfChunks = (numberOfChunks > 4*numberOfThreads) ? 4*numberOfThreads : numberOfChunks;
+    std::vector<const char*> chunkStarts(numberOfChunks + 1);
+    chunkStarts[0] = p;
+    for (vtkIdType k = 1; k < numberOfChunks; ++k)
+    {
+        const char* split = p + k*bodySize/numberOfChunks;
+        split = (split < chunkStarts[k-1]) ? chunkStarts[k-1] : split;
+        chunkStarts[k] = (split == p) ? p : NextLine(FindLineEnd(split - 1,end),end);
+    }
+    chunkStarts[numberOfChunks] = end;
+
+    // count the lines in each chunk to find the row each chunk starts at
+    std::vector<vtkIdType> firstRows(numberOfChunks + 1,0);
+    LineCounter counter(chunkStarts,firstRows);
+    ParallelRange::Execute(numberOfChunks,&counter,1,numberOfThreads);
+    for (vtkIdType k = 0; k < numberOfChunks; ++k)
+    {
+        firstRows[k+1] += firstRows[k];
+    }
+
+    if (pointData->GetScalarType() == VTK_FLOAT)
+    {
+        ParseChunks(chunkStarts,firstRows,static_cast<float*>(scalars),xDimension,yDimension,numberOfThreads);
+    }
+    else
+    {
+        ParseChunks(chunkStarts,firstRows,static_cast<double*>(scalars),xDimension,yDimension,numberOfThreads);
+    }
+
+    double bytesRead = inFile.size();
+    inFile.close();
+
+    return ReadThroughput(bytesRead,vtkTimerLog::GetUniversalTime() - startTime);
+}
+
+void ReadDaVis::SetSinglePrecision( bool single )
+{
+    if (m_singlePrecision != single) {m_singlePrecision = single;}
+}
+bool ReadDaVis::GetSinglePrecision()
+{
+    return m_singlePrecision;
+}
+
+void ReadDaVis::SetStageTimer( StageTimer* timer )
+{
+    if (m_stageTimer != timer) {m_stageTimer = timer;}
+}
+StageTimer* ReadDaVis::GetStageTimer()
+{
+    return m_stageTimer;
+}
+
+void ReadDaVis::SetGridTriangulation( bool grid )
+{
+    if (m_gridTriangulation != grid) {m_gridTriangulation = grid;}
+}
+bool ReadDaVis::GetGridTriangulation()
+{
+    return m_gridTriangulation;
 }
 
 void ReadDaVis::CreateDataSurface()
 {
+    ScopedStage stage(m_stageTimer,"surface build");
+    if (m_gridTriangulation)
+    {
+        CreateGridSurface();
+        return;
+    }
+
     // find out which point set has fewer points
+    std::vector<vtkImageData*> strainGrids;
+    std::vector<std::string> arrayNames;
+    GetStrainGrids(strainGrids,arrayNames);
     int* heightDimensions = m_heightData->GetDimensions();
-    int* strainDimensions = m_strainData->GetDimensions();
-    int xEnd = (heightDimensions[0] > strainDimensions[0]) ? strainDimensions[0] : heightDimensions[0];
-    int yEnd = (heightDimensions[1] > strainDimensions[1]) ? strainDimensions[1] : heightDimensions[1];
+    int xEnd = heightDimensions[0];
+    int yEnd = heightDimensions[1];
+    std::vector<vtkSmartPointer<vtkDataArray> > surfaceArrays;
+    for (size_t k = 0; k < strainGrids.size(); ++k)
+    {
+        int* strainDimensions = strainGrids[k]->GetDimensions();
+        xEnd = (xEnd > strainDimensions[0]) ? strainDimensions[0] : xEnd;
+        yEnd = (yEnd > strainDimensions[1]) ? strainDimensions[1] : yEnd;
+        surfaceArrays.push_back(NewScalarArray(strainGrids[k]->GetScalarType()));
+        surfaceArrays[k]->SetName(arrayNames[k].c_str());
+    }
 
     vtkSmartPointer<vtkPoints>  surfacePoints = vtkSmartPointer<vtkPoints>::New();
-    vtkSmartPointer<vtkDoubleArray> surfaceArray = vtkSmartPointer<vtkDoubleArray>::New();
-    surfaceArray->SetNumberOfComponents(1);
-    surfaceArray->SetName("MinPStrain");
 
     // iterate through x and y, if the data for both != 0, then save the point
     for (int i = 0; i<xEnd; ++i)
@@ -139,7 +1035,11 @@ void ReadDaVis::CreateDataSurface()
                 pointIndex[2] = 0;
                 double* pointLocation = m_heightData->GetPoint(m_heightData->ComputePointId(pointIndex));
                 surfacePoints->InsertNextPoint(pointLocation[0],pointLocation[1],heightPoint);
-                surfaceArray->InsertNextTuple1(strainPoint);
+                surfaceArrays[0]->InsertNextTuple1(strainPoint);
+                for (size_t k = 1; k < strainGrids.size(); ++k)
+                {
+                    surfaceArrays[k]->InsertNextTuple1(strainGrids[k]->GetScalarComponentAsDouble(i,j,0,0));
+                }
 
             }
 
@@ -147,18 +1047,200 @@ void ReadDaVis::CreateDataSurface()
     }
 
     m_surface->SetPoints(surfacePoints);
-    m_surface->GetPointData()->AddArray(surfaceArray);
+    for (size_t k = 0; k < surfaceArrays.size(); ++k)
+    {
+        m_surface->GetPointData()->AddArray(surfaceArrays[k]);
+    }
 
     // use Delaunay2D to create a mesh, ignoring the z-dimension
 //    vtkSmartPointer<vtkUnstructuredGrid> tempSurf = vtkSmartPointer<vtkUnstructuredGrid>::New();
 //    tempSurf->DeepCopy(m_surface);
     vtkSmartPointer<vtkDelaunay2D> delauney = vtkSmartPointer<vtkDelaunay2D>::New();
     delauney->SetInput(m_surface);
+    ScopedStage delaunayStage(m_stageTimer,"delaunay");
     delauney->Update();
+    delaunayStage.Stop();
     m_surface = delauney->GetOutput();
 
 }
 
+void ReadDaVis::CreateGridSurface()
+{
+    // the height and strain grids are parsed with the same precision
+    std::vector<vtkImageData*> strainGrids;
+    std::vector<std::string> arrayNames;
+    GetStrainGrids(strainGrids,arrayNames);
+    int scalarType = m_heightData->GetScalarType();
+    for (size_t k = 0; k < strainGrids.size(); ++k)
+    {
+        if (scalarType != strainGrids[k]->GetScalarType())
+        {
+            std::cerr<<"The height and strain data have different scalar types."<<std::endl;
+            m_surface = vtkSmartPointer<vtkPolyData>::New();
+            return;
+        }
+    }
+    if (scalarType == VTK_FLOAT)
+    {
+        m_surface = BuildGridSurface<float>(m_heightData,strainGrids,arrayNames,m_numberOfThreads);
+    }
+    else
+    {
+        m_surface = BuildGridSurface<double>(m_heightData,strainGrids,arrayNames,m_numberOfThreads);
+    }
+}
+
+void ReadDaVis::GetStrainGrids(std::vector<vtkImageData*>& grids, std::vector<std::string>& names)
+{
+    grids.assign(1,m_strainData.GetPointer());
+    names.assign(1,"MinPStrain");
+    for (size_t k = 0; k < m_componentData.size(); ++k)
+    {
+        grids.push_back(m_componentData[k]);
+        names.push_back(m_componentNames[k]);
+    }
+}
+
+void ReadDaVis::StreamDataSurface()
+{
+    ScopedStage stage(m_stageTimer,"surface build");
+    // open the height and strain files and read their headers, the first
+    // strain file is the strain file and the rest are the components
+    std::vector<std::string> strainFileNames(1,m_strainFileName);
+    strainFileNames.insert(strainFileNames.end(),m_componentFileNames.begin(),m_componentFileNames.end());
+    std::vector<std::string> arrayNames(1,"MinPStrain");
+    arrayNames.insert(arrayNames.end(),m_componentNames.begin(),m_componentNames.end());
+    size_t numberOfStrains = strainFileNames.size();
+
+    std::ifstream heightFile(m_heightFileName.c_str());
+    boost::scoped_array<std::ifstream> strainFiles(new std::ifstream[numberOfStrains]);
+    if (!heightFile)
+    {
+        std::cerr << "Cannot open\n" <<m_heightFileName<<"\nPlease check the name and try again."<<std::endl;
+        return;
+    }
+    vtkSmartPointer<vtkImageData> heightGrid = vtkSmartPointer<vtkImageData>::New();
+    std::string heightLine;
+    std::getline(heightFile,heightLine);
+    if (!ReadHeader(heightLine,heightGrid))
+    {
+        std::cerr << "Cannot read the header of\n" <<m_heightFileName<<std::endl;
+        return;
+    }
+
+    // find out which point set has fewer points
+    int xEnd = heightGrid->GetDimensions()[0];
+    int yEnd = heightGrid->GetDimensions()[1];
+    std::vector<std::string> strainLines(numberOfStrains);
+    for (size_t k = 0; k < numberOfStrains; ++k)
+    {
+        strainFiles[k].open(strainFileNames[k].c_str());
+        if (!strainFiles[k])
+        {
+            std::cerr << "Cannot open\n" <<strainFileNames[k]<<"\nPlease check the name and try again."<<std::endl;
+            return;
+        }
+        vtkSmartPointer<vtkImageData> strainGrid = vtkSmartPointer<vtkImageData>::New();
+        std::getline(strainFiles[k],strainLines[k]);
+        if (!ReadHeader(strainLines[k],strainGrid))
+        {
+            std::cerr << "Cannot read the header of\n" <<strainFileNames[k]<<std::endl;
+            return;
+        }
+        int* strainDimensions = strainGrid->GetDimensions();
+        xEnd = (xEnd > strainDimensions[0]) ? strainDimensions[0] : xEnd;
+        yEnd = (yEnd > strainDimensions[1]) ? strainDimensions[1] : yEnd;
+    }
+    if (xEnd < 1 || yEnd < 1)
+    {
+        m_surface = vtkSmartPointer<vtkPolyData>::New();
+        return;
+    }
+    double* origin = heightGrid->GetOrigin();
+    double* spacing = heightGrid->GetSpacing();
+    // keep the triangles counter clockwise in x-y, like vtkDelaunay2D
+    bool flip = spacing[0]*spacing[1] < 0;
+
+    vtkSmartPointer<vtkPoints> surfacePoints = vtkSmartPointer<vtkPoints>::New();
+    surfacePoints->SetDataTypeToFloat();
+    std::vector<vtkSmartPointer<vtkDataArray> > surfaceArrays;
+    for (size_t k = 0; k < numberOfStrains; ++k)
+    {
+        surfaceArrays.push_back(NewScalarArray(m_singlePrecision ? VTK_FLOAT : VTK_DOUBLE));
+        surfaceArrays[k]->SetName(arrayNames[k].c_str());
+    }
+    vtkSmartPointer<vtkCellArray> triangles = vtkSmartPointer<vtkCellArray>::New();
+
+    // only the current and previous rows are kept
+    std::vector<double> heights(yEnd);
+    std::vector<std::vector<double> > strains(numberOfStrains,std::vector<double>(yEnd));
+    std::vector<vtkIdType> previousIds(yEnd,-1);
+    std::vector<vtkIdType> currentIds(yEnd,-1);
+    for (int i = 0; i < xEnd; ++i)
+    {
+        // a missing line reads as a row of zeros, like the other parsers
+        if (!std::getline(heightFile,heightLine))
+        {
+            heightLine.clear();
+        }
+        ParseRow(heightLine.data(),heightLine.data() + heightLine.size(),&heights[0],1,yEnd);
+        for (size_t k = 0; k < numberOfStrains; ++k)
+        {
+            if (!std::getline(strainFiles[k],strainLines[k]))
+            {
+                strainLines[k].clear();
+            }
+            ParseRow(strainLines[k].data(),strainLines[k].data() + strainLines[k].size(),&strains[k][0],1,yEnd);
+        }
+        if (m_singlePrecision)
+        {
+            // round before the mask so the points kept match the other modes
+            for (int j = 0; j < yEnd; ++j)
+            {
+                heights[j] = static_cast<float>(heights[j]);
+                strains[0][j] = static_cast<float>(strains[0][j]);
+            }
+        }
+
+        // iterate through y, if the data for both != 0, then save the point
+        for (int j = 0; j < yEnd; ++j)
+        {
+            currentIds[j] = -1;
+            if (heights[j] != 0 && strains[0][j] != 0)
+            {
+                currentIds[j] = surfacePoints->InsertNextPoint(origin[0] + i*spacing[0],origin[1] + j*spacing[1],heights[j]);
+                for (size_t k = 0; k < numberOfStrains; ++k)
+                {
+                    surfaceArrays[k]->InsertNextTuple1(strains[k][j]);
+                }
+            }
+        }
+
+        // connect this row to the previous one
+        for (int j = 0; i > 0 && j < yEnd - 1; ++j)
+        {
+            vtkIdType cell[8];
+            if (GridSquareTriangles(&previousIds[0],&currentIds[0],j,flip,cell))
+            {
+                triangles->InsertNextCell(3,cell + 1);
+                triangles->InsertNextCell(3,cell + 5);
+            }
+        }
+        previousIds.swap(currentIds);
+    }
+
+    surfacePoints->Squeeze();
+    triangles->Squeeze();
+    m_surface = vtkSmartPointer<vtkPolyData>::New();
+    m_surface->SetPoints(surfacePoints);
+    m_surface->SetPolys(triangles);
+    for (size_t k = 0; k < numberOfStrains; ++k)
+    {
+        surfaceArrays[k]->Squeeze();
+        m_surface->GetPointData()->AddArray(surfaceArrays[k]);
+    }
+}
+
 vtkSmartPointer<vtkImageData> ReadDaVis::GetHeightData()
 {
     return m_heightData;
@@ -169,8 +1251,28 @@ vtkSmartPointer<vtkImageData> ReadDaVis::GetStrainData()
     return m_strainData;
 }
 
+vtkSmartPointer<vtkImageData> ReadDaVis::GetStrainComponentData( int component )
+{
+    return m_componentData[component];
+}
+
 vtkSmartPointer<vtkPolyData> ReadDaVis::GetSurface()
 //vtkSmartPointer<vtkUnstructuredGrid> ReadDaVis::GetSurface()
 {
     return m_surface;
 }
+
+double ReadDaVis::GetHeightReadRate()
+{
+    return m_heightReadRate;
+}
+
+double ReadDaVis::GetStrainReadRate()
+{
+    return m_strainReadRate;
+}
+
+double ReadDaVis::GetStrainComponentReadRate( int component )
+{
+    return m_componentReadRates[component];
+}
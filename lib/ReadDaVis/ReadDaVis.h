@@ -24,13 +24,21 @@
 #include <cstring>
 #include <sstream>
 #include <iterator>
+#include <vector>
 #include <boost/tokenizer.hpp>
 #include <vtkSmartPointer.h>
 #include <vtkPointData.h>
 #include <vtkPolyData.h>
 #include <vtkImageData.h>
 #include <vtkDoubleArray.h>
+#include <vtkFloatArray.h>
 #include <vtkDelaunay2D.h>
+#include <vtkCellArray.h>
+#include <vtkIdTypeArray.h>
+#include <vtkTimerLog.h>
+#include "../ParallelRange/ParallelRange.h"
+#include "../BinaryCache/BinaryCache.h"
+#include "../StageTimer/StageTimer.h"
 
 
 class ReadDaVis
@@ -45,32 +53,138 @@ public:
     std::string GetHeightFileName();
     /** Set the strain file name. **/
     void SetStrainFileName( std::string fileName );
+    /** Add another strain component file, measured on the same grid as
+      * the strain file. It is read with the other files and attached to
+      * the surface as a point array called arrayName, alongside the
+      * "MinPStrain" array, so every component shares one triangulation.
+      * Points are still kept or dropped on the height and strain files
+      * alone. **/
+    void AddStrainComponent( std::string fileName, std::string arrayName );
+    /** Remove the strain components added with AddStrainComponent. **/
+    void RemoveAllStrainComponents();
+    int GetNumberOfStrainComponents();
 
     /** Read the height file **/
     void ReadHeightFile();
-    /** Read the strain file **/
+    /** Read the strain file and any strain components **/
     void ReadStrainFile();
+    /** Read the height and strain files at the same time. **/
+    void ReadAll();
+    /** Read the height and strain files of every reader at the same time.
+      * The parsing threads are shared out between the files, so the wall
+      * time is about that of the slowest file rather than the sum. **/
+    static void ReadAll(std::vector<ReadDaVis*> readers);
     /** Read a file given in fileName and put the results in the pointset **/
     void ReadFile(std::string fileName, vtkSmartPointer<vtkImageData> pointData);
+    /** Set/Get whether the files are memory mapped and parsed in place,
+      * writing straight into the image scalars. When off, the original
+      * line by line stream parser is used. The default is on. **/
+    void SetMappedParsing( bool mapped );
+    bool GetMappedParsing();
+    /** Set/Get the number of threads used to parse a mapped file. Large
+      * files are split into chunks at line boundaries and the chunks are
+      * parsed concurrently. The default of 0 uses every processor. **/
+    void SetNumberOfThreads( int numberOfThreads );
+    int GetNumberOfThreads();
+    /** Set/Get whether parsed files are cached. When on, a binary copy of
+      * each parsed grid is written next to its file as fileName.cache,
+      * holding the header values and the raw scalars, written with a
+      * BinaryCacheWriter. Later reads map the cache instead of parsing
+      * and use the mapped scalars in place, without copying them, as long
+      * as the size and modification time of the file still match those
+      * the cache is keyed on. The mapping is copy on write, so the grid
+      * may still be changed. The default is off. **/
+    void SetBinaryCache( bool cache );
+    bool GetBinaryCache();
+    /** Set/Get whether the grids are read as floats instead of doubles.
+      * The height and strain scalars, the strain array on the surface and
+      * any cache written are then single precision, halving their memory
+      * and bandwidth. Caches of the other precision are re-parsed. The
+      * default is off. **/
+    void SetSinglePrecision( bool single );
+    bool GetSinglePrecision();
+    /** Set/Get the timer the stages are added to: "parse" for each file
+      * read, "surface build" for CreateDataSurface and StreamDataSurface,
+      * which parses as it builds, and "delaunay" for the triangulation
+      * inside CreateDataSurface. The timer is not owned. The default of
+      * null times nothing. **/
+    void SetStageTimer( StageTimer* timer );
+    StageTimer* GetStageTimer();
     /** Put the height data into a surface and put the z-comp of the strain
       * point data as a dataset at the points of the hight data. **/
     void CreateDataSurface();
+    /** Set/Get whether CreateDataSurface triangulates using the grid the
+      * data was measured on instead of vtkDelaunay2D. Each grid square with
+      * four valid corners becomes two triangles, so masked holes and
+      * concave edges are kept rather than bridged. The default is off. **/
+    void SetGridTriangulation( bool grid );
+    bool GetGridTriangulation();
+    /** Build the same surface as CreateDataSurface with grid triangulation
+      * without reading the files into the height and strain point data
+      * first. The files are read together a line at a time and the
+      * points and triangles of each pair of rows are added straight to
+      * the surface, so only two rows of each file are held in memory. The
+      * height and strain point data are left untouched. **/
+    void StreamDataSurface();
 
     /** Get the height point data. **/
     vtkSmartPointer<vtkImageData> GetHeightData();
     /** Get the strain point data. **/
     vtkSmartPointer<vtkImageData> GetStrainData();
+    /** Get the point data of a strain component. **/
+    vtkSmartPointer<vtkImageData> GetStrainComponentData( int component );
     /** Get the surface. **/
     vtkSmartPointer<vtkPolyData> GetSurface();
     //vtkSmartPointer<vtkUnstructuredGrid> GetSurface();
 
+    /** Get the parse throughput of the last height and strain file reads
+      * in MB/s. A value of 0 means the file has not been read and -1 that
+      * the read failed. **/
+    double GetHeightReadRate();
+    double GetStrainReadRate();
+    double GetStrainComponentReadRate( int component );
+
 
 private:
+    friend class ReadDaVisFileJobs;
+
+    /** Parse the DaVis header line and set the dimensions, origin and
+      * spacing of pointData. Returns false if the header is malformed. **/
+    bool ReadHeader(std::string headerLine, vtkImageData* pointData);
+    /** The two parsers used by ReadFile. Both return the throughput in
+      * MB/s, or -1 if the file could not be read. **/
+    double ReadStreamFile(std::string fileName, vtkImageData* pointData);
+    double ReadMappedFile(std::string fileName, vtkImageData* pointData, int numberOfThreads);
+    /** The grid triangulation used by CreateDataSurface. **/
+    void CreateGridSurface();
+    /** Read the grid from the cache of fileName. Returns the throughput
+      * in MB/s, or -1 if there is no up to date cache. **/
+    double ReadCacheFile(std::string fileName, vtkImageData* pointData);
+    /** Write the grid read from fileName to its cache. **/
+    void WriteCacheFile(std::string fileName, vtkImageData* pointData);
+    /** Dispatch to the cache or one of the parsers above. **/
+    double ParseFile(std::string fileName, vtkImageData* pointData, int numberOfThreads);
+    /** The strain grids attached to the surface, starting with the strain
+      * data, and the names of their arrays. **/
+    void GetStrainGrids(std::vector<vtkImageData*>& grids, std::vector<std::string>& names);
+
     std::string                                 m_heightFileName;
     std::string                                 m_strainFileName;
     vtkSmartPointer<vtkImageData>               m_heightData;
     vtkSmartPointer<vtkImageData>               m_strainData;
     vtkSmartPointer<vtkPolyData>                m_surface;
+    bool                                        m_mappedParsing;
+    int                                         m_numberOfThreads;
+    bool                                        m_gridTriangulation;
+    bool                                        m_binaryCache;
+    bool                                        m_singlePrecision;
+    double                                      m_heightReadRate;
+    double                                      m_strainReadRate;
+    std::vector<std::string>                    m_componentFileNames;
+    std::vector<std::string>                    m_componentNames;
+    std::vector<vtkSmartPointer<vtkImageData> > m_componentData;
+    std::vector<double>                         m_componentReadRates;
+    StageTimer*                                 m_stageTimer;
     //vtkSmartPointer<vtkUnstructuredGrid>        m_surface;
 
 };
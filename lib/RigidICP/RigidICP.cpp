@@ -0,0 +1,707 @@
+/*
+ * RigidICP.cpp
+ *
+ * Copyright 2013 Seth Gilchrist <seth@fake.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#include "RigidICP.h"
+#include <cmath>
+#include <algorithm>
+
+namespace
+{
+inline double Dot(const double a[3], const double b[3])
+{
+    return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+}
+
+/** The closest point to p on the triangle a, b, c, by the region of the
+  * triangle p projects into. **/
+void ClosestPointOnTriangle(const double p[3], const double a[3], const double b[3], const double c[3], double closest[3])
+{
+    double ab[3] = {b[0] - a[0],b[1] - a[1],b[2] - a[2]};
+    double ac[3] = {c[0] - a[0],c[1] - a[1],c[2] - a[2]};
+    double ap[3] = {p[0] - a[0],p[1] - a[1],p[2] - a[2]};
+    double d1 = Dot(ab,ap);
+    double d2 = Dot(ac,ap);
+    if (d1 <= 0 && d2 <= 0)
+    {
+        std::copy(a,a + 3,closest);
+        return;
+    }
+    double bp[3] = {p[0] - b[0],p[1] - b[1],p[2] - b[2]};
+    double d3 = Dot(ab,bp);
+    double d4 = Dot(ac,bp);
+    if (d3 >= 0 && d4 <= d3)
+    {
+        std::copy(b,b + 3,closest);
+        return;
+    }
+    double vc = d1*d4 - d3*d2;
+    if (vc <= 0 && d1 >= 0 && d3 <= 0)
+    {
+        double v = d1/(d1 - d3);
+        for (int k = 0; k < 3; ++k)
+        {
+            closest[k] = a[k] + v*ab[k];
+        }
+        return;
+    }
+    double cp[3] = {p[0] - c[0],p[1] - c[1],p[2] - c[2]};
+    double d5 = Dot(ab,cp);
+    double d6 = Dot(ac,cp);
+    if (d6 >= 0 && d5 <= d6)
+    {
+        std::copy(c,c + 3,closest);
+        return;
+    }
+    double vb = d5*d2 - d1*d6;
+    if (vb <= 0 && d2 >= 0 && d6 <= 0)
+    {
+        double w = d2/(d2 - d6);
+        for (int k = 0; k < 3; ++k)
+        {
+            closest[k] = a[k] + w*ac[k];
+        }
+        return;
+    }
+    double va = d3*d6 - d5*d4;
+    if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0)
+    {
+        double w = (d4 - d3)/((d4 - d3) + (d5 - d6));
+        for (int k = 0; k < 3; ++k)
+        {
+            closest[k] = b[k] + w*(c[k] - b[k]);
+        }
+        return;
+    }
+    double denominator = 1/(va + vb + vc);
+    double v = vb*denominator;
+    double w = vc*denominator;
+    for (int k = 0; k < 3; ++k)
+    {
+        closest[k] = a[k] + v*ab[k] + w*ac[k];
+    }
+}
+
+/** Finds the closest target point to each landmark: the closest point
+  * on the triangles around the closest target point, or that point if it
+  * is on no triangle. A landmark with no closest point is matched to
+  * itself. When normals is given, the normal of the triangle matched, or
+  * zero for a point, goes there. **/
+class CorrespondenceFinder : public ParallelRangeFunctor
+{
+public:
+    CorrespondenceFinder(const PointKdTree& tree, const std::vector<vtkIdType>& triangles,
+                         const std::vector<double>& triangleNormals, const std::vector<vtkIdType>& pointTriangleOffsets,
+                         const std::vector<vtkIdType>& pointTriangles, const double* landmarks, double* matches,
+                         double* normals)
+        : m_tree(tree), m_triangles(triangles), m_triangleNormals(triangleNormals),
+          m_pointTriangleOffsets(pointTriangleOffsets), m_pointTriangles(pointTriangles),
+          m_landmarks(landmarks), m_matches(matches), m_normals(normals)
+    {
+    }
+
+    void Execute(vtkIdType begin, vtkIdType end, int)
+    {
+        double dist2;
+        double corners[3][3];
+        double closest[3];
+        for (vtkIdType i = begin; i < end; ++i)
+        {
+            const double* x = m_landmarks + 3*i;
+            double* match = m_matches + 3*i;
+            vtkIdType point = m_tree.FindClosestPoint(x,dist2);
+            vtkIdType matchedTriangle = -1;
+            if (point < 0)
+            {
+                // nothing is closest to a landmark that is not finite, so it is
+                // matched to itself and asks for no movement
+                std::copy(x,x + 3,match);
+            }
+            else
+            {
+                m_tree.GetPoint(point,match);
+            }
+            if (point >= 0 && !m_pointTriangleOffsets.empty())
+            {
+                for (vtkIdType t = m_pointTriangleOffsets[point]; t < m_pointTriangleOffsets[point+1]; ++t)
+                {
+                    const vtkIdType* ids = &m_triangles[3*m_pointTriangles[t]];
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        m_tree.GetPoint(ids[k],corners[k]);
+                    }
+                    ClosestPointOnTriangle(x,corners[0],corners[1],corners[2],closest);
+                    double d2 = (x[0] - closest[0])*(x[0] - closest[0]) + (x[1] - closest[1])*(x[1] - closest[1]) +
+                                (x[2] - closest[2])*(x[2] - closest[2]);
+                    if (d2 < dist2 || matchedTriangle == -1)
+                    {
+                        dist2 = d2;
+                        matchedTriangle = m_pointTriangles[t];
+                        std::copy(closest,closest + 3,match);
+                    }
+                }
+            }
+            if (m_normals)
+            {
+                double* normal = m_normals + 3*i;
+                if (matchedTriangle == -1)
+                {
+                    normal[0] = normal[1] = normal[2] = 0;
+                }
+                else
+                {
+                    std::copy(&m_triangleNormals[3*matchedTriangle],&m_triangleNormals[3*matchedTriangle] + 3,normal);
+                }
+            }
+        }
+    }
+
+private:
+    const PointKdTree&              m_tree;
+    const std::vector<vtkIdType>&   m_triangles;
+    const std::vector<double>&      m_triangleNormals;
+    const std::vector<vtkIdType>&   m_pointTriangleOffsets;
+    const std::vector<vtkIdType>&   m_pointTriangles;
+    const double*                   m_landmarks;
+    double*                         m_matches;
+    double*                         m_normals;
+};
+
+// the fewest landmarks the coarse levels of a pyramid are cut down to
+const vtkIdType minimumLandmarks = 50;
+
+/** The rigid transform that best moves the points from onto the points to,
+  * by Horn's method: the rotation is the eigenvector of the largest
+  * eigenvalue of a 4x4 matrix built from the cross covariance, read as a
+  * quaternion. The result goes in the first three rows of transform. **/
+void SolveRigidTransform(const std::vector<double>& from, const std::vector<double>& to, double transform[3][4])
+{
+    size_t numberOfPoints = from.size()/3;
+    double fromCentroid[3] = {0,0,0};
+    double toCentroid[3] = {0,0,0};
+    for (size_t i = 0; i < numberOfPoints; ++i)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            fromCentroid[c] += from[3*i+c];
+            toCentroid[c] += to[3*i+c];
+        }
+    }
+    for (int c = 0; c < 3; ++c)
+    {
+        fromCentroid[c] /= numberOfPoints;
+        toCentroid[c] /= numberOfPoints;
+    }
+
+    // the cross covariance of the centred points
+    double M[3][3] = {{0,0,0},{0,0,0},{0,0,0}};
+    for (size_t i = 0; i < numberOfPoints; ++i)
+    {
+        double a[3];
+        double b[3];
+        for (int c = 0; c < 3; ++c)
+        {
+            a[c] = from[3*i+c] - fromCentroid[c];
+            b[c] = to[3*i+c] - toCentroid[c];
+        }
+        for (int r = 0; r < 3; ++r)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                M[r][c] += a[r]*b[c];
+            }
+        }
+    }
+
+    double N[4][4];
+    N[0][0] = M[0][0] + M[1][1] + M[2][2];
+    N[1][1] = M[0][0] - M[1][1] - M[2][2];
+    N[2][2] = -M[0][0] + M[1][1] - M[2][2];
+    N[3][3] = -M[0][0] - M[1][1] + M[2][2];
+    N[0][1] = N[1][0] = M[1][2] - M[2][1];
+    N[0][2] = N[2][0] = M[2][0] - M[0][2];
+    N[0][3] = N[3][0] = M[0][1] - M[1][0];
+    N[1][2] = N[2][1] = M[0][1] + M[1][0];
+    N[1][3] = N[3][1] = M[2][0] + M[0][2];
+    N[2][3] = N[3][2] = M[1][2] + M[2][1];
+
+    double eigenvectorData[4][4];
+    double eigenvalues[4];
+    double* NRows[4] = {N[0],N[1],N[2],N[3]};
+    double* eigenvectors[4] = {eigenvectorData[0],eigenvectorData[1],eigenvectorData[2],eigenvectorData[3]};
+    vtkMath::JacobiN(NRows,4,eigenvalues,eigenvectors);
+
+    // the eigenvectors are sorted largest first and stored in columns
+    double quaternion[4] = {eigenvectorData[0][0],eigenvectorData[1][0],eigenvectorData[2][0],eigenvectorData[3][0]};
+    double rotation[3][3];
+    vtkMath::QuaternionToMatrix3x3(quaternion,rotation);
+    for (int r = 0; r < 3; ++r)
+    {
+        transform[r][3] = toCentroid[r];
+        for (int c = 0; c < 3; ++c)
+        {
+            transform[r][c] = rotation[r][c];
+            transform[r][3] -= rotation[r][c]*fromCentroid[c];
+        }
+    }
+}
+
+/** The rigid transform that best moves the points from onto the planes
+  * through the points to with the given normals. The rotation is taken as
+  * small, so the squared distances to the planes are linear least squares
+  * in the rotation angles and translation, solved with
+  * vtkMath::SolveLinearSystem. The angles are then made into an exact
+  * rotation. Returns false, leaving transform unset, if the planes do not
+  * fix the transform, as when they are all parallel. **/
+bool SolvePointToPlaneTransform(const std::vector<double>& from, const std::vector<double>& to,
+                                const std::vector<double>& normals, double transform[3][4])
+{
+    // the normal equations of rows [from x normal, normal] . [angles, translation] = (to - from) . normal
+    double AData[6][6];
+    double b[6] = {0,0,0,0,0,0};
+    std::fill(&AData[0][0],&AData[0][0] + 36,0.0);
+    size_t numberOfPoints = from.size()/3;
+    for (size_t i = 0; i < numberOfPoints; ++i)
+    {
+        const double* p = &from[3*i];
+        const double* q = &to[3*i];
+        const double* n = &normals[3*i];
+        double row[6] = {p[1]*n[2] - p[2]*n[1],p[2]*n[0] - p[0]*n[2],p[0]*n[1] - p[1]*n[0],n[0],n[1],n[2]};
+        double distance = (q[0] - p[0])*n[0] + (q[1] - p[1])*n[1] + (q[2] - p[2])*n[2];
+        for (int r = 0; r < 6; ++r)
+        {
+            for (int c = 0; c < 6; ++c)
+            {
+                AData[r][c] += row[r]*row[c];
+            }
+            b[r] += row[r]*distance;
+        }
+    }
+    double* A[6] = {AData[0],AData[1],AData[2],AData[3],AData[4],AData[5]};
+    if (!vtkMath::SolveLinearSystem(A,b,6))
+    {
+        return false;
+    }
+
+    // rotate by the length of the angles about their direction
+    double angle = sqrt(b[0]*b[0] + b[1]*b[1] + b[2]*b[2]);
+    double rotation[3][3] = {{1,0,0},{0,1,0},{0,0,1}};
+    if (angle > 0)
+    {
+        double half = sin(angle/2)/angle;
+        double quaternion[4] = {cos(angle/2),b[0]*half,b[1]*half,b[2]*half};
+        vtkMath::QuaternionToMatrix3x3(quaternion,rotation);
+    }
+    for (int r = 0; r < 3; ++r)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            transform[r][c] = rotation[r][c];
+        }
+        transform[r][3] = b[r+3];
+    }
+    return true;
+}
+}
+
+RigidICP::RigidICP()
+{
+    m_maximumNumberOfIterations = 50;
+    m_tolerance = 0.001;
+    m_maximumNumberOfLandmarks = 200;
+    m_numberOfLevels = 1;
+    m_finestLevelIterations = 5;
+    m_pointToPlane = false;
+    m_startByMatchingCentroids = false;
+    m_numberOfThreads = 0;
+    m_matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    m_numberOfIterations = 0;
+    m_meanDistance = 0;
+}
+
+void RigidICP::SetSource(vtkPoints* source)
+{
+    m_source = source;
+}
+
+void RigidICP::SetTarget(vtkPolyData* target)
+{
+    m_target = target;
+    m_targetTree.Build(target->GetPoints());
+
+    // the triangles of the target and the triangles around each point
+    m_triangles.clear();
+    m_triangleNormals.clear();
+    m_pointTriangleOffsets.clear();
+    m_pointTriangles.clear();
+    vtkCellArray* polys = target->GetPolys();
+    if (!polys || polys->GetNumberOfCells() == 0)
+    {
+        return;
+    }
+    const vtkIdType* polyData = polys->GetPointer();
+    vtkIdType numberOfEntries = polys->GetNumberOfConnectivityEntries();
+    for (vtkIdType location = 0; location < numberOfEntries; location += polyData[location] + 1)
+    {
+        if (polyData[location] == 3)
+        {
+            m_triangles.insert(m_triangles.end(),polyData + location + 1,polyData + location + 4);
+        }
+    }
+    m_triangleNormals.resize(m_triangles.size());
+    for (size_t i = 0; i < m_triangles.size(); i += 3)
+    {
+        double a[3];
+        double b[3];
+        double c[3];
+        target->GetPoint(m_triangles[i],a);
+        target->GetPoint(m_triangles[i+1],b);
+        target->GetPoint(m_triangles[i+2],c);
+        double ab[3] = {b[0] - a[0],b[1] - a[1],b[2] - a[2]};
+        double ac[3] = {c[0] - a[0],c[1] - a[1],c[2] - a[2]};
+        double* normal = &m_triangleNormals[i];
+        vtkMath::Cross(ab,ac,normal);
+        double length = sqrt(Dot(normal,normal));
+        for (int k = 0; k < 3 && length > 0; ++k)
+        {
+            normal[k] /= length;
+        }
+    }
+    vtkIdType numberOfPoints = target->GetNumberOfPoints();
+    m_pointTriangleOffsets.assign(numberOfPoints + 1,0);
+    for (size_t i = 0; i < m_triangles.size(); ++i)
+    {
+        ++m_pointTriangleOffsets[m_triangles[i] + 1];
+    }
+    for (vtkIdType i = 0; i < numberOfPoints; ++i)
+    {
+        m_pointTriangleOffsets[i+1] += m_pointTriangleOffsets[i];
+    }
+    m_pointTriangles.resize(m_triangles.size());
+    std::vector<vtkIdType> filled(m_pointTriangleOffsets.begin(),m_pointTriangleOffsets.end() - 1);
+    for (size_t i = 0; i < m_triangles.size(); ++i)
+    {
+        m_pointTriangles[filled[m_triangles[i]]++] = i/3;
+    }
+}
+
+void RigidICP::WriteTarget(BinaryCacheWriter& writer)
+{
+    m_targetTree.Write(writer);
+    writer.Write(m_triangles);
+    writer.Write(m_triangleNormals);
+    writer.Write(m_pointTriangleOffsets);
+    writer.Write(m_pointTriangles);
+}
+
+bool RigidICP::ReadTarget(vtkPolyData* target, BinaryCacheReader& reader)
+{
+    vtkIdType numberOfPoints = target->GetNumberOfPoints();
+    if (m_targetTree.Read(reader) && reader.Read(m_triangles) && reader.Read(m_triangleNormals) &&
+        reader.Read(m_pointTriangleOffsets) && reader.Read(m_pointTriangles) &&
+        m_targetTree.GetNumberOfPoints() == numberOfPoints && m_triangleNormals.size() == m_triangles.size() &&
+        m_pointTriangles.size() == m_triangles.size() &&
+        (m_triangles.empty() || m_pointTriangleOffsets.size() == static_cast<size_t>(numberOfPoints) + 1))
+    {
+        m_target = target;
+        return true;
+    }
+    m_target = 0;
+    m_targetTree.Build(vtkSmartPointer<vtkPoints>::New());
+    m_triangles.clear();
+    m_triangleNormals.clear();
+    m_pointTriangleOffsets.clear();
+    m_pointTriangles.clear();
+    return false;
+}
+
+void RigidICP::SetMaximumNumberOfIterations(int iterations)
+{
+    if (m_maximumNumberOfIterations != iterations)
+    {
+        m_maximumNumberOfIterations = iterations;
+    }
+}
+
+int RigidICP::GetMaximumNumberOfIterations()
+{
+    return m_maximumNumberOfIterations;
+}
+
+void RigidICP::SetTolerance(double tolerance)
+{
+    if (m_tolerance != tolerance)
+    {
+        m_tolerance = tolerance;
+    }
+}
+
+double RigidICP::GetTolerance()
+{
+    return m_tolerance;
+}
+
+void RigidICP::SetMaximumNumberOfLandmarks(vtkIdType landmarks)
+{
+    if (m_maximumNumberOfLandmarks != landmarks)
+    {
+        m_maximumNumberOfLandmarks = landmarks;
+    }
+}
+
+vtkIdType RigidICP::GetMaximumNumberOfLandmarks()
+{
+    return m_maximumNumberOfLandmarks;
+}
+
+void RigidICP::SetNumberOfLevels(int levels)
+{
+    if (m_numberOfLevels != levels)
+    {
+        m_numberOfLevels = (levels < 1) ? 1 : levels;
+    }
+}
+
+int RigidICP::GetNumberOfLevels()
+{
+    return m_numberOfLevels;
+}
+
+void RigidICP::SetFinestLevelIterations(int iterations)
+{
+    if (m_finestLevelIterations != iterations)
+    {
+        m_finestLevelIterations = iterations;
+    }
+}
+
+int RigidICP::GetFinestLevelIterations()
+{
+    return m_finestLevelIterations;
+}
+
+void RigidICP::SetPointToPlane(bool plane)
+{
+    if (m_pointToPlane != plane)
+    {
+        m_pointToPlane = plane;
+    }
+}
+
+bool RigidICP::GetPointToPlane()
+{
+    return m_pointToPlane;
+}
+
+void RigidICP::SetStartByMatchingCentroids(bool match)
+{
+    if (m_startByMatchingCentroids != match)
+    {
+        m_startByMatchingCentroids = match;
+    }
+}
+
+bool RigidICP::GetStartByMatchingCentroids()
+{
+    return m_startByMatchingCentroids;
+}
+
+void RigidICP::SetNumberOfThreads(int numberOfThreads)
+{
+    if (m_numberOfThreads != numberOfThreads)
+    {
+        m_numberOfThreads = numberOfThreads;
+    }
+}
+
+int RigidICP::GetNumberOfThreads()
+{
+    return m_numberOfThreads;
+}
+
+void RigidICP::FindCorrespondences(const std::vector<double>& landmarks, std::vector<double>& matches, std::vector<double>* normals)
+{
+    matches.resize(landmarks.size());
+    if (normals)
+    {
+        normals->resize(landmarks.size());
+    }
+    CorrespondenceFinder finder(m_targetTree,m_triangles,m_triangleNormals,m_pointTriangleOffsets,m_pointTriangles,
+                                &landmarks[0],&matches[0],normals ? &(*normals)[0] : 0);
+    ParallelRange::Execute(landmarks.size()/3,&finder,0,m_numberOfThreads);
+}
+
+int RigidICP::RunLevel(std::vector<double>& landmarks, int maximumNumberOfIterations, double tolerance, double total[3][4])
+{
+    size_t numberOfLandmarks = landmarks.size()/3;
+    std::vector<double> matches;
+    std::vector<double> normals;
+    bool pointToPlane = m_pointToPlane && !m_triangles.empty();
+    int iterations = 0;
+    while (iterations < maximumNumberOfIterations)
+    {
+        FindCorrespondences(landmarks,matches,pointToPlane ? &normals : 0);
+        double distance2 = 0;
+        for (size_t i = 0; i < landmarks.size(); ++i)
+        {
+            distance2 += (matches[i] - landmarks[i])*(matches[i] - landmarks[i]);
+        }
+        m_meanDistance = sqrt(distance2/numberOfLandmarks);
+
+        // move the landmarks and add the increment to the total transform
+        double increment[3][4];
+        if (!pointToPlane || !SolvePointToPlaneTransform(landmarks,matches,normals,increment))
+        {
+            SolveRigidTransform(landmarks,matches,increment);
+        }
+        double moved2 = 0;
+        for (size_t i = 0; i < numberOfLandmarks; ++i)
+        {
+            double* x = &landmarks[3*i];
+            double y[3];
+            for (int r = 0; r < 3; ++r)
+            {
+                y[r] = increment[r][0]*x[0] + increment[r][1]*x[1] + increment[r][2]*x[2] + increment[r][3];
+            }
+            moved2 += (y[0] - x[0])*(y[0] - x[0]) + (y[1] - x[1])*(y[1] - x[1]) + (y[2] - x[2])*(y[2] - x[2]);
+            x[0] = y[0];
+            x[1] = y[1];
+            x[2] = y[2];
+        }
+        double product[3][4];
+        for (int r = 0; r < 3; ++r)
+        {
+            for (int c = 0; c < 4; ++c)
+            {
+                product[r][c] = increment[r][0]*total[0][c] + increment[r][1]*total[1][c] + increment[r][2]*total[2][c];
+            }
+            product[r][3] += increment[r][3];
+        }
+        std::copy(&product[0][0],&product[0][0] + 12,&total[0][0]);
+        ++iterations;
+
+        if (sqrt(moved2/numberOfLandmarks) < tolerance)
+        {
+            break;
+        }
+    }
+    return iterations;
+}
+
+void RigidICP::Update()
+{
+    m_matrix->Identity();
+    m_numberOfIterations = 0;
+    m_meanDistance = 0;
+    if (!m_source || !m_target || m_source->GetNumberOfPoints() == 0 || m_targetTree.GetNumberOfPoints() == 0)
+    {
+        return;
+    }
+
+    // the transform so far, kept as the first three rows of a 4x4 matrix
+    vtkIdType numberOfPoints = m_source->GetNumberOfPoints();
+    double total[3][4] = {{1,0,0,0},{0,1,0,0},{0,0,1,0}};
+    double x[3];
+    if (m_startByMatchingCentroids)
+    {
+        double sourceCentroid[3] = {0,0,0};
+        double targetCentroid[3] = {0,0,0};
+        for (vtkIdType i = 0; i < numberOfPoints; ++i)
+        {
+            m_source->GetPoint(i,x);
+            sourceCentroid[0] += x[0];
+            sourceCentroid[1] += x[1];
+            sourceCentroid[2] += x[2];
+        }
+        for (vtkIdType i = 0; i < m_target->GetNumberOfPoints(); ++i)
+        {
+            m_target->GetPoint(i,x);
+            targetCentroid[0] += x[0];
+            targetCentroid[1] += x[1];
+            targetCentroid[2] += x[2];
+        }
+        for (int c = 0; c < 3; ++c)
+        {
+            total[c][3] = targetCentroid[c]/m_target->GetNumberOfPoints() - sourceCentroid[c]/numberOfPoints;
+        }
+    }
+
+    // run from the coarsest level to the finest, each starting from the
+    // transform of the last
+    for (int level = m_numberOfLevels - 1; level >= 0; --level)
+    {
+        // sample the landmarks evenly from the source, a quarter as many for
+        // each coarser level but never fewer than minimumLandmarks
+        vtkIdType numberOfLandmarks = numberOfPoints;
+        if (m_maximumNumberOfLandmarks > 0 && numberOfLandmarks > m_maximumNumberOfLandmarks)
+        {
+            numberOfLandmarks = m_maximumNumberOfLandmarks;
+        }
+        for (int l = 0; l < level && numberOfLandmarks/4 >= minimumLandmarks; ++l)
+        {
+            numberOfLandmarks /= 4;
+        }
+        vtkIdType step = numberOfPoints/numberOfLandmarks;
+        std::vector<double> landmarks;
+        landmarks.reserve(3*(numberOfPoints/step + 1));
+        for (vtkIdType i = 0; i < numberOfPoints; i += step)
+        {
+            m_source->GetPoint(i,x);
+            for (int r = 0; r < 3; ++r)
+            {
+                landmarks.push_back(total[r][0]*x[0] + total[r][1]*x[1] + total[r][2]*x[2] + total[r][3]);
+            }
+        }
+
+        // the coarse levels only need a rough pose, so stop at a looser tolerance,
+        // and the finest starts close, so needs only a few iterations
+        int maximumNumberOfIterations = m_maximumNumberOfIterations;
+        if (level == 0 && m_numberOfLevels > 1 && m_finestLevelIterations > 0)
+        {
+            maximumNumberOfIterations = m_finestLevelIterations;
+        }
+        m_numberOfIterations += RunLevel(landmarks,maximumNumberOfIterations,m_tolerance*pow(2.0,level),total);
+    }
+
+    for (int r = 0; r < 3; ++r)
+    {
+        for (int c = 0; c < 4; ++c)
+        {
+            m_matrix->SetElement(r,c,total[r][c]);
+        }
+    }
+}
+
+vtkSmartPointer<vtkMatrix4x4> RigidICP::GetMatrix()
+{
+    return m_matrix;
+}
+
+int RigidICP::GetNumberOfIterations()
+{
+    return m_numberOfIterations;
+}
+
+double RigidICP::GetMeanDistance()
+{
+    return m_meanDistance;
+}
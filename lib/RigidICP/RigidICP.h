@@ -0,0 +1,156 @@
+/*
+ * RigidICP.h
+ *
+ * Copyright 2013 Seth Gilchrist <seth@fake.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#ifndef RIGIDICP_H
+#define RIGIDICP_H
+
+#include <vector>
+#include <vtkSmartPointer.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkCellArray.h>
+#include <vtkMatrix4x4.h>
+#include <vtkMath.h>
+#include "../PointKdTree/PointKdTree.h"
+#include "../BinaryCache/BinaryCache.h"
+#include "../ParallelRange/ParallelRange.h"
+
+/** A rigid iterative closest point registration, in place of
+  * vtkIterativeClosestPointTransform. Each iteration matches a sample of
+  * the source points (the landmarks) to the closest points of the target
+  * surface, in parallel, and moves the landmarks by the rigid transform
+  * that best fits the matches, found in closed form with Horn's
+  * quaternion method. The closest target point is found with a
+  * PointKdTree and the match is the closest point on the triangles
+  * around it. **/
+class RigidICP
+{
+public:
+
+    /** Constructor **/
+    RigidICP();
+
+    /** Set the points to be moved onto the target. **/
+    void SetSource( vtkPoints* source );
+    /** Set the surface the source is moved onto. The k-d tree over its
+      * points and the triangles around each point are built here and kept
+      * until another target is set. A target without triangles is matched
+      * by its points alone. **/
+    void SetTarget( vtkPolyData* target );
+    /** Write what SetTarget built from the target to a cache. **/
+    void WriteTarget( BinaryCacheWriter& writer );
+    /** Set the target with what WriteTarget wrote for it, in place of
+      * building it. Returns false, leaving no target set, if the cache
+      * does not hold a whole target with as many points as target. **/
+    bool ReadTarget( vtkPolyData* target, BinaryCacheReader& reader );
+    /** Set/Get the most iterations run. The default is 50. **/
+    void SetMaximumNumberOfIterations( int iterations );
+    int GetMaximumNumberOfIterations();
+    /** Set/Get the tolerance. The iterations stop once the landmarks move
+      * less than this, as a root mean square, in an iteration. A value of
+      * 0 always runs every iteration. The default is 0.001. **/
+    void SetTolerance( double tolerance );
+    double GetTolerance();
+    /** Set/Get the most source points used as landmarks. Larger sources
+      * are sampled evenly down to this many. A value of 0 uses every
+      * point. The default is 200. **/
+    void SetMaximumNumberOfLandmarks( vtkIdType landmarks );
+    vtkIdType GetMaximumNumberOfLandmarks();
+    /** Set/Get the number of levels of a coarse to fine pyramid. Each
+      * level above the first samples a quarter as many landmarks from the
+      * source as the level below, but not fewer than 50, and stops at a
+      * tolerance twice as loose. The levels are run coarsest first, each
+      * starting from the transform of the last. Every level is matched
+      * to the full target surface, as averaging the target down was found
+      * to bias the coarse poses. The default of 1 runs the finest level
+      * alone. **/
+    void SetNumberOfLevels( int levels );
+    int GetNumberOfLevels();
+    /** Set/Get the most iterations run on the finest level when there is
+      * more than one level. The coarser levels run up to
+      * GetMaximumNumberOfIterations() each. A value of 0 uses that for
+      * the finest level too. The default is 5. **/
+    void SetFinestLevelIterations( int iterations );
+    int GetFinestLevelIterations();
+    /** Set/Get whether each step minimises the distances from the
+      * landmarks to the planes of the target triangles they are matched
+      * to, rather than to the matched points. On smooth surfaces this
+      * lets the source slide along the target and converges in far fewer
+      * iterations. The triangle normals are found when the target is set.
+      * A target without triangles is always matched point to point. The
+      * default is off. **/
+    void SetPointToPlane( bool plane );
+    bool GetPointToPlane();
+    /** Set/Get whether the source is first moved so its centroid is on
+      * that of the target. The default is off. **/
+    void SetStartByMatchingCentroids( bool match );
+    bool GetStartByMatchingCentroids();
+    /** Set/Get the number of threads used to find the closest points.
+      * The default of 0 uses every processor. **/
+    void SetNumberOfThreads( int numberOfThreads );
+    int GetNumberOfThreads();
+
+    /** Run the registration. **/
+    void Update();
+
+    /** Get the transform from the source onto the target found by the
+      * last Update. **/
+    vtkSmartPointer<vtkMatrix4x4> GetMatrix();
+    /** Get the number of iterations run by the last Update, over all
+      * levels. **/
+    int GetNumberOfIterations();
+    /** Get the root mean square distance from the landmarks to their
+      * closest target points at the last iteration. This is the point to
+      * point distance in either mode, so the modes can be compared. **/
+    double GetMeanDistance();
+
+private:
+
+    /** Find the closest target point to each landmark, and the normal of
+      * the triangle it is on if normals is given. **/
+    void FindCorrespondences( const std::vector<double>& landmarks, std::vector<double>& matches, std::vector<double>* normals );
+    /** Run the iterations of one level, moving landmarks and adding each
+      * step to total. Returns the number of iterations run. **/
+    int RunLevel( std::vector<double>& landmarks, int maximumNumberOfIterations, double tolerance, double total[3][4] );
+
+    vtkSmartPointer<vtkPoints>      m_source;
+    vtkSmartPointer<vtkPolyData>    m_target;
+    PointKdTree                     m_targetTree;
+    std::vector<vtkIdType>          m_triangles;        // three point ids per target triangle
+    std::vector<double>             m_triangleNormals;
+    std::vector<vtkIdType>          m_pointTriangleOffsets;
+    std::vector<vtkIdType>          m_pointTriangles;   // the triangles around point i are m_pointTriangles[m_pointTriangleOffsets[i]...m_pointTriangleOffsets[i+1]-1]
+    int                             m_maximumNumberOfIterations;
+    double                          m_tolerance;
+    vtkIdType                       m_maximumNumberOfLandmarks;
+    int                             m_numberOfLevels;
+    int                             m_finestLevelIterations;
+    bool                            m_pointToPlane;
+    bool                            m_startByMatchingCentroids;
+    int                             m_numberOfThreads;
+    vtkSmartPointer<vtkMatrix4x4>   m_matrix;
+    int                             m_numberOfIterations;
+    double                          m_meanDistance;
+};
+
+#endif // RIGIDICP_H
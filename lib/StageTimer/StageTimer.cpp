@@ -0,0 +1,155 @@
+/*
+ * StageTimer.cpp
+ *
+ * Copyright 2013 Seth Gilchrist <seth@fake.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#include "StageTimer.h"
+#include <cstdio>
+#include <fstream>
+#include <vtkTimerLog.h>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+namespace
+{
+/** name with the characters JSON can't hold in a string escaped. **/
+std::string EscapeJSON(const std::string& name)
+{
+    std::string escaped;
+    for (size_t i = 0; i < name.size(); ++i)
+    {
+        if (name[i] == '"' || name[i] == '\\')
+        {
+            escaped += '\\';
+        }
+        escaped += name[i];
+    }
+    return escaped;
+}
+}
+
+StageTimer::StageTimer()
+{
+    m_startTime = vtkTimerLog::GetUniversalTime();
+}
+
+void StageTimer::AddStage( std::string name, double seconds )
+{
+    double peakMemory = GetPeakMemory();
+    m_lock.Lock();
+    size_t i = 0;
+    while (i < m_stages.size() && m_stages[i].name != name)
+    {
+        ++i;
+    }
+    if (i == m_stages.size())
+    {
+        Stage stage;
+        stage.name = name;
+        stage.calls = 0;
+        stage.seconds = 0;
+        stage.peakMemory = 0;
+        m_stages.push_back(stage);
+    }
+    m_stages[i].calls += 1;
+    m_stages[i].seconds += seconds;
+    m_stages[i].peakMemory = (peakMemory > m_stages[i].peakMemory) ? peakMemory : m_stages[i].peakMemory;
+    m_lock.Unlock();
+}
+
+void StageTimer::PrintSummary( std::ostream& out )
+{
+    double runTime = vtkTimerLog::GetUniversalTime() - m_startTime;
+    char line[128];
+    m_lock.Lock();
+    out<<"Stage                Calls     Seconds  % of Run  Peak MB"<<std::endl;
+    for (size_t i = 0; i < m_stages.size(); ++i)
+    {
+        const Stage& stage = m_stages[i];
+        snprintf(line,sizeof(line),"%-20s %6d %11.3f %9.1f %8.1f",stage.name.c_str(),stage.calls,stage.seconds,
+                 (runTime > 0) ? 100*stage.seconds/runTime : 0.0,stage.peakMemory);
+        out<<line<<std::endl;
+    }
+    m_lock.Unlock();
+    snprintf(line,sizeof(line),"%-20s %6s %11.3f %9.1f %8.1f","run","",runTime,100.0,GetPeakMemory());
+    out<<line<<std::endl;
+}
+
+bool StageTimer::WriteJSON( std::string fileName )
+{
+    double runTime = vtkTimerLog::GetUniversalTime() - m_startTime;
+    std::ofstream outFile(fileName.c_str());
+    if (!outFile)
+    {
+        return false;
+    }
+    outFile.precision(17);
+    outFile<<"{\n  \"seconds\": "<<runTime<<",\n  \"peakMemoryMB\": "<<GetPeakMemory()<<",\n  \"stages\": [";
+    m_lock.Lock();
+    for (size_t i = 0; i < m_stages.size(); ++i)
+    {
+        const Stage& stage = m_stages[i];
+        outFile<<(i ? ",\n" : "\n")<<"    {\"name\": \""<<EscapeJSON(stage.name)<<"\", \"calls\": "<<stage.calls<<
+                 ", \"seconds\": "<<stage.seconds<<", \"peakMemoryMB\": "<<stage.peakMemory<<"}";
+    }
+    m_lock.Unlock();
+    outFile<<"\n  ]\n}\n";
+    return outFile.good();
+}
+
+double StageTimer::GetPeakMemory()
+{
+#ifndef _WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF,&usage) == 0)
+    {
+#ifdef __APPLE__
+        // bytes on OS X, kilobytes elsewhere
+        return usage.ru_maxrss/1048576.0;
+#else
+        return usage.ru_maxrss/1024.0;
+#endif
+    }
+#endif
+    return -1;
+}
+
+ScopedStage::ScopedStage( StageTimer* timer, const char* name )
+{
+    m_timer = timer;
+    m_name = name;
+    m_startTime = timer ? vtkTimerLog::GetUniversalTime() : 0;
+}
+
+ScopedStage::~ScopedStage()
+{
+    Stop();
+}
+
+void ScopedStage::Stop()
+{
+    if (m_timer)
+    {
+        m_timer->AddStage(m_name,vtkTimerLog::GetUniversalTime() - m_startTime);
+        m_timer = 0;
+    }
+}
@@ -0,0 +1,99 @@
+/*
+ * StageTimer.h
+ *
+ * Copyright 2013 Seth Gilchrist <seth@fake.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#ifndef STAGETIMER_H
+#define STAGETIMER_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <vtkCriticalSection.h>
+
+/** Adds up the time spent in each named stage of a run and the peak
+  * memory of the process at the end of each, for a summary table and a
+  * JSON file. Stages can be added from several threads at once. Stages
+  * inside other stages, such as the Delaunay triangulation inside the
+  * surface build, are counted in both, and stages run on several threads
+  * at once add up, so the stages may total more than the run. **/
+class StageTimer
+{
+public:
+
+    /** Constructor. The run is timed from here. **/
+    StageTimer();
+
+    /** Add seconds to the stage called name and note the peak memory. The
+      * stages are kept in the order they are first added. **/
+    void AddStage( std::string name, double seconds );
+
+    /** Print a table of the stages: the times each ran, the seconds spent
+      * in it, the share of the run that is and the peak memory. **/
+    void PrintSummary( std::ostream& out );
+    /** Write the stages to fileName as JSON. Returns false if the file
+      * can't be written. **/
+    bool WriteJSON( std::string fileName );
+
+    /** The peak resident memory of the process so far in MB, or -1 where
+      * it can't be found. **/
+    static double GetPeakMemory();
+
+private:
+
+    /** One stage of the run. **/
+    struct Stage
+    {
+        std::string name;
+        int         calls;
+        double      seconds;
+        double      peakMemory;
+    };
+
+    std::vector<Stage>          m_stages;
+    double                      m_startTime;
+    vtkSimpleCriticalSection    m_lock;
+};
+
+/** Times one stage, from construction until Stop is called or it goes out
+  * of scope, and adds it to a StageTimer. Nothing is timed if the timer
+  * is null, so the stages of a class cost nothing unless a timer is set. **/
+class ScopedStage
+{
+public:
+
+    ScopedStage( StageTimer* timer, const char* name );
+    ~ScopedStage();
+
+    /** End the stage before the end of the scope. **/
+    void Stop();
+
+private:
+
+    ScopedStage( const ScopedStage& );
+    ScopedStage& operator=( const ScopedStage& );
+
+    StageTimer*     m_timer;
+    const char*     m_name;
+    double          m_startTime;
+};
+
+#endif // STAGETIMER_H
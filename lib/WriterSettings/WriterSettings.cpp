@@ -0,0 +1,219 @@
+/*
+ * WriterSettings.cpp
+ *
+ * Copyright 2013 Seth Gilchrist <seth@fake.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#include "WriterSettings.h"
+#include <cstdlib>
+#include <sstream>
+#include <vtkSmartPointer.h>
+#include <vtkZLibDataCompressor.h>
+#include <vtkTimerLog.h>
+#include <boost/filesystem.hpp>
+
+WriterSettings::WriterSettings()
+{
+    m_dataMode = Appended;
+    m_encodeAppendedData = false;
+    m_compression = true;
+    m_compressionLevel = 1;
+    m_blockSize = 32768;
+}
+
+void WriterSettings::SetDataMode( DataMode mode )
+{
+    if (m_dataMode != mode) {m_dataMode = mode;}
+}
+WriterSettings::DataMode WriterSettings::GetDataMode()
+{
+    return m_dataMode;
+}
+
+void WriterSettings::SetEncodeAppendedData( bool encode )
+{
+    if (m_encodeAppendedData != encode) {m_encodeAppendedData = encode;}
+}
+bool WriterSettings::GetEncodeAppendedData()
+{
+    return m_encodeAppendedData;
+}
+
+void WriterSettings::SetCompression( bool compression )
+{
+    if (m_compression != compression) {m_compression = compression;}
+}
+bool WriterSettings::GetCompression()
+{
+    return m_compression;
+}
+
+void WriterSettings::SetCompressionLevel( int level )
+{
+    level = (level < 0) ? 0 : (level > 9) ? 9 : level;
+    if (m_compressionLevel != level) {m_compressionLevel = level;}
+}
+int WriterSettings::GetCompressionLevel()
+{
+    return m_compressionLevel;
+}
+
+void WriterSettings::SetBlockSize( size_t blockSize )
+{
+    // the blocks must hold a whole number of the largest values written
+    blockSize = (blockSize < 8) ? 8 : blockSize/8*8;
+    if (m_blockSize != blockSize) {m_blockSize = blockSize;}
+}
+size_t WriterSettings::GetBlockSize()
+{
+    return m_blockSize;
+}
+
+int WriterSettings::ParseOption( int argc, char **argv, int i )
+{
+    std::string option = argv[i];
+    bool hasValue = (i + 1 < argc);
+    if (option == "--vtk-mode" && hasValue)
+    {
+        std::string mode = argv[i+1];
+        if (mode == "appended")
+        {
+            SetDataMode(Appended);
+        }
+        else if (mode == "binary")
+        {
+            SetDataMode(Binary);
+        }
+        else if (mode == "ascii")
+        {
+            SetDataMode(Ascii);
+        }
+        else
+        {
+            std::cout<<"Unknown VTK data mode "<<mode<<" ignored."<<std::endl;
+        }
+        return 2;
+    }
+    if (option == "--vtk-base64")
+    {
+        SetEncodeAppendedData(true);
+        return 1;
+    }
+    if (option == "--vtk-compressor" && hasValue)
+    {
+        std::string compressor = argv[i+1];
+        if (compressor == "zlib")
+        {
+            SetCompression(true);
+        }
+        else if (compressor == "none")
+        {
+            SetCompression(false);
+        }
+        else
+        {
+            std::cout<<"Unknown VTK compressor "<<compressor<<" ignored."<<std::endl;
+        }
+        return 2;
+    }
+    if (option == "--vtk-level" && hasValue)
+    {
+        SetCompressionLevel(atoi(argv[i+1]));
+        return 2;
+    }
+    if (option == "--vtk-block-size" && hasValue)
+    {
+        SetBlockSize(atol(argv[i+1]));
+        return 2;
+    }
+    return 0;
+}
+
+void WriterSettings::PrintOptions( std::ostream& out )
+{
+    out<<"  --vtk-mode [Mode]     Write the VTK files as appended, binary or ascii. The default is appended."<<std::endl;
+    out<<"  --vtk-base64          Base64 encode the appended data instead of writing raw bytes."<<std::endl;
+    out<<"  --vtk-compressor [C]  Compress the VTK data with zlib or none. The default is zlib."<<std::endl;
+    out<<"  --vtk-level [N]       The zlib level from 0 to 9, higher is smaller and slower. The default is 1."<<std::endl;
+    out<<"  --vtk-block-size [N]  Compress the VTK data in blocks of N bytes. The default is 32768."<<std::endl;
+}
+
+std::string WriterSettings::GetDescription() const
+{
+    std::stringstream description;
+    const char* modeNames[] = {"appended","binary","ascii"};
+    description<<modeNames[m_dataMode];
+    if (m_dataMode == Appended)
+    {
+        description<<(m_encodeAppendedData ? " base64" : " raw");
+    }
+    if (m_dataMode != Ascii && m_compression)
+    {
+        description<<", zlib level "<<m_compressionLevel<<", blocks of "<<m_blockSize;
+    }
+    else if (m_dataMode != Ascii)
+    {
+        description<<", uncompressed";
+    }
+    return description.str();
+}
+
+void WriterSettings::Apply( vtkXMLWriter* writer ) const
+{
+    if (m_dataMode == Appended)
+    {
+        writer->SetDataModeToAppended();
+    }
+    else if (m_dataMode == Binary)
+    {
+        writer->SetDataModeToBinary();
+    }
+    else
+    {
+        writer->SetDataModeToAscii();
+    }
+    writer->SetEncodeAppendedData(m_encodeAppendedData);
+    if (m_compression)
+    {
+        vtkSmartPointer<vtkZLibDataCompressor> compressor = vtkSmartPointer<vtkZLibDataCompressor>::New();
+        compressor->SetCompressionLevel(m_compressionLevel);
+        writer->SetCompressor(compressor);
+    }
+    else
+    {
+        writer->SetCompressor(0);
+    }
+    writer->SetBlockSize(m_blockSize);
+}
+
+int WriterSettings::Write( vtkXMLWriter* writer, std::ostream& log ) const
+{
+    Apply(writer);
+    double startTime = vtkTimerLog::GetUniversalTime();
+    int written = writer->Write();
+    double seconds = vtkTimerLog::GetUniversalTime() - startTime;
+    if (written)
+    {
+        boost::system::error_code error;
+        boost::uintmax_t size = boost::filesystem::file_size(writer->GetFileName(),error);
+        log<<(error ? 0 : size/1.0e6)<<" MB written in "<<seconds<<" s ("<<GetDescription()<<")";
+    }
+    return written;
+}
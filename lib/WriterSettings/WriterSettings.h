@@ -0,0 +1,96 @@
+/*
+ * WriterSettings.h
+ *
+ * Copyright 2013 Seth Gilchrist <seth@fake.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ *
+ */
+
+#ifndef WRITERSETTINGS_H
+#define WRITERSETTINGS_H
+
+#include <string>
+#include <iostream>
+#include <vtkXMLWriter.h>
+
+/** How the VTK XML files are written: the data mode, whether appended
+  * data is base64 encoded, the compressor and its level and the block
+  * size the data is compressed in. The same settings are used for every
+  * writer they are applied to, so one object can be shared between
+  * threads once it is set up. **/
+class WriterSettings
+{
+public:
+
+    /** The data modes of vtkXMLWriter. **/
+    enum DataMode
+    {
+        Appended,
+        Binary,
+        Ascii
+    };
+
+    /** Constructor. The defaults are appended raw data, compressed with
+      * zlib at level 1 in blocks of 32768 bytes. **/
+    WriterSettings();
+
+    /** Set/Get the data mode. The default is Appended. **/
+    void SetDataMode( DataMode mode );
+    DataMode GetDataMode();
+    /** Set/Get whether appended data is base64 encoded rather than
+      * written as raw bytes. The default is off. **/
+    void SetEncodeAppendedData( bool encode );
+    bool GetEncodeAppendedData();
+    /** Set/Get whether the data is compressed with zlib, the only
+      * compressor of this VTK. The default is on. **/
+    void SetCompression( bool compression );
+    bool GetCompression();
+    /** Set/Get the zlib level, from 0 to 9. Higher levels are smaller
+      * and slower. The default is 1. **/
+    void SetCompressionLevel( int level );
+    int GetCompressionLevel();
+    /** Set/Get the size in bytes of the blocks the data is compressed
+      * in. The default is 32768. **/
+    void SetBlockSize( size_t blockSize );
+    size_t GetBlockSize();
+
+    /** Read the writer option at argv[i], if it is one. Returns the
+      * number of arguments it used, or 0 if it is not a writer option. **/
+    int ParseOption( int argc, char **argv, int i );
+    /** Print the writer options to out, for a usage message. **/
+    static void PrintOptions( std::ostream& out );
+    /** A short description of the settings, for reports. **/
+    std::string GetDescription() const;
+
+    /** Set writer up with the settings. **/
+    void Apply( vtkXMLWriter* writer ) const;
+    /** Apply the settings to writer and write its file. The size of the
+      * file and the time taken are added to log, without ending the line.
+      * Returns the result of vtkXMLWriter::Write. **/
+    int Write( vtkXMLWriter* writer, std::ostream& log ) const;
+
+private:
+
+    DataMode    m_dataMode;
+    bool        m_encodeAppendedData;
+    bool        m_compression;
+    int         m_compressionLevel;
+    size_t      m_blockSize;
+};
+
+#endif // WRITERSETTINGS_H